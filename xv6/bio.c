@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -17,79 +17,256 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// Blocks are hashed by (dev, blockno) into NBUCKET buckets.  Each
+// bucket has its own lock and its own LRU list, so lookups of
+// different blocks rarely contend.  The cache starts empty and grows
+// with buffers carved from kalloc() pages up to NBUF; after that a
+// miss recycles the least recently used free buffer, first from its
+// own bucket and then from any other (cross-bucket eviction).
+//
+// Lock order: bcache.lock, then a bucket lock.  bcache.lock
+// serializes growth and cross-bucket eviction.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "x86.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "iostat.h"
 
-struct {
-  struct spinlock lock;
-  struct buf buf[NBUF];
+#define NBUCKET 61
+#define BHASH(dev, blockno) (((dev) * 31 + (blockno)) % NBUCKET)
 
-  // Linked list of all buffers, through prev/next.
+struct bucket {
+  struct spinlock lock;
+  // Linked list of the bucket's buffers, through prev/next.
   // head.next is most recently used.
   struct buf head;
+  uint hits;
+  uint misses;
+  uint evictions;
+};
+
+struct {
+  struct spinlock lock;  // protects the fields below
+  uint nbuf;
+  volatile uint nahead;  // read-ahead requests issued
+  char *hdrpage;   // unused part of the page for buf headers
+  uint nhdr;
+  char *datapage;  // unused part of the page for buf data
+  uint ndata;
+
+  struct bucket bucket[NBUCKET];
 } bcache;
 
 void
 binit(void)
 {
-  struct buf *b;
+  struct bucket *bk;
 
   initlock(&bcache.lock, "bcache");
 
 //PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  // Create empty bucket lists
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    initlock(&bk->lock, "bcache.bucket");
+    bk->head.prev = &bk->head;
+    bk->head.next = &bk->head;
+  }
+}
+
+// Remove b from its bucket list.
+static void
+bunlink(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+}
+
+// Insert b at the head (MRU end) of bk's list.
+static void
+bpush(struct bucket *bk, struct buf *b)
+{
+  b->next = bk->head.next;
+  b->prev = &bk->head;
+  bk->head.next->prev = b;
+  bk->head.next = b;
+}
+
+// Least recently used buffer of bk that nobody is using.
+// Even if refcnt==0, B_DIRTY indicates a buffer is in use
+// because log.c has modified it but not yet committed it.
+// Caller must hold bk->lock.
+static struct buf*
+blru(struct bucket *bk)
+{
+  struct buf *b;
+
+  for(b = bk->head.prev; b != &bk->head; b = b->prev)
+    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0)
+      return b;
+  return 0;
+}
+
+// Carve a new buffer out of kalloc() pages.
+// Returns 0 if out of memory.  Caller must hold bcache.lock.
+static struct buf*
+bnew(void)
+{
+  struct buf *b;
+
+  if(bcache.nhdr == 0){
+    if((bcache.hdrpage = kalloc()) == 0)
+      return 0;
+    bcache.nhdr = PGSIZE / sizeof(struct buf);
+  }
+  if(bcache.ndata == 0){
+    if((bcache.datapage = kalloc()) == 0)
+      return 0;
+    bcache.ndata = PGSIZE / BSIZE;
+  }
+  b = (struct buf*)bcache.hdrpage;
+  bcache.hdrpage += sizeof(struct buf);
+  bcache.nhdr--;
+  memset(b, 0, sizeof(*b));
+  b->data = (uchar*)bcache.datapage;
+  bcache.datapage += BSIZE;
+  bcache.ndata--;
+  initsleeplock(&b->lock, "buffer");
+  bcache.nbuf++;
+  return b;
+}
+
+// Find block on device dev in bk.  Caller must hold bk->lock.
+static struct buf*
+bfind(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bk->head.next; b != &bk->head; b = b->next)
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  return 0;
+}
+
+// Slow path of bget(): grow the cache or take a free buffer
+// from any bucket.  Called without bucket locks held.
+static struct buf*
+bsteal(uint dev, uint blockno, int ahead)
+{
+  struct bucket *bk, *vb;
+  struct buf *b, *cached;
+  int i, h;
+
+  h = BHASH(dev, blockno);
+  bk = &bcache.bucket[h];
+
+  acquire(&bcache.lock);
+  b = 0;
+  if(bcache.nbuf < NBUF)
+    b = bnew();
+  // Own bucket last: bget() already found nothing free there,
+  // but brelse() may have freed something since.
+  for(i = 1; b == 0 && i <= NBUCKET; i++){
+    vb = &bcache.bucket[(h + i) % NBUCKET];
+    acquire(&vb->lock);
+    if((b = blru(vb)) != 0){
+      bunlink(b);
+      if(b->flags & B_VALID)
+        vb->evictions++;
+    }
+    release(&vb->lock);
+  }
+  if(b == 0){
+    // Read-ahead is only a hint: skip it rather than panic.
+    if(ahead){
+      release(&bcache.lock);
+      return 0;
+    }
+    panic("bget: no buffers");
   }
+
+  acquire(&bk->lock);
+  // Someone may have cached the block while no lock was held.
+  if((cached = bfind(bk, dev, blockno)) != 0){
+    // Keep b as a free buffer of this bucket; its old identity
+    // hashes elsewhere, so it can never be found by mistake.
+    b->flags = 0;
+    b->refcnt = 0;
+    bpush(bk, b);
+    if(ahead){
+      release(&bk->lock);
+      release(&bcache.lock);
+      return 0;
+    }
+    cached->refcnt++;
+    bk->hits++;
+    b = cached;
+  } else {
+    b->dev = dev;
+    b->blockno = blockno;
+    b->flags = 0;
+    b->refcnt = 1;
+    bk->misses++;
+    bpush(bk, b);
+  }
+  release(&bk->lock);
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
+// For read-ahead (ahead != 0), return 0 instead if the block is
+// already cached or in use, so the caller never sleeps on it.
 static struct buf*
-bget(uint dev, uint blockno)
+bget(uint dev, uint blockno, int ahead)
 {
+  struct bucket *bk;
   struct buf *b;
 
-  acquire(&bcache.lock);
+  bk = &bcache.bucket[BHASH(dev, blockno)];
+  acquire(&bk->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  if((b = bfind(bk, dev, blockno)) != 0){
+    if(ahead && ((b->flags & B_VALID) || b->refcnt > 0)){
+      release(&bk->lock);
+      return 0;
     }
+    b->refcnt++;
+    bk->hits++;
+    release(&bk->lock);
+    acquiresleep(&b->lock);
+    return b;
   }
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  // Not cached; recycle an unused buffer of this bucket,
+  // unless the cache can still grow.
+  if(bcache.nbuf >= NBUF && (b = blru(bk)) != 0){
+    if(b->flags & B_VALID)
+      bk->evictions++;
+    b->dev = dev;
+    b->blockno = blockno;
+    b->flags = 0;
+    b->refcnt = 1;
+    bk->misses++;
+    bunlink(b);
+    bpush(bk, b);
+    release(&bk->lock);
+    acquiresleep(&b->lock);
+    return b;
   }
-  panic("bget: no buffers");
+  release(&bk->lock);
+
+  return bsteal(dev, blockno, ahead);
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -98,13 +275,53 @@ bread(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, blockno);
+  b = bget(dev, blockno, 0);
   if((b->flags & B_VALID) == 0) {
     iderw(b);
   }
   return b;
 }
 
+// Start reading the indicated block into the cache without
+// waiting for it.  Does nothing if the block is already cached
+// or busy.  The disk driver releases the buffer (brelse_async())
+// when the read completes; a bread() meanwhile sleeps on the
+// buffer lock until then.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bget(dev, blockno, 1)) == 0)
+    return;
+  if(b->flags & B_VALID){
+    brelse(b);
+    return;
+  }
+  xadd(&bcache.nahead, 1);
+  bsubmit(b, 0);
+}
+
+// Start the disk transfer for locked buffer b and return at once:
+// write it if B_DIRTY is set, else read it.  The caller gives b
+// up; the disk driver releases it when the transfer is done.
+// If bt is not 0, bwait(bt) waits for that.  Submitting many
+// bufs before waiting lets the disk driver sort and merge them.
+void
+bsubmit(struct buf *b, struct bbatch *bt)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bsubmit");
+  iderw_submit(b, bt);
+}
+
+// Wait for every buffer submitted with bt.
+void
+bwait(struct bbatch *bt)
+{
+  iderw_wait(bt);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -116,29 +333,94 @@ bwrite(struct buf *b)
 }
 
 // Release a locked buffer.
-// Move to the head of the MRU list.
+// Move to the head of its bucket's MRU list.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  // b->dev and b->blockno can't change while refcnt > 0.
+  bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+  acquire(&bk->lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    bunlink(b);
+    bpush(bk, b);
   }
   
-  release(&bcache.lock);
+  release(&bk->lock);
+}
+
+// Keep b in the cache, as if still referenced, until bunpin().
+// Caller must hold b locked.
+void
+bpin(struct buf *b)
+{
+  struct bucket *bk;
+
+  bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+  acquire(&bk->lock);
+  b->refcnt++;
+  release(&bk->lock);
+}
+
+// Drop the reference taken by bpin().
+void
+bunpin(struct buf *b)
+{
+  struct bucket *bk;
+
+  bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+  acquire(&bk->lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    bunlink(b);
+    bpush(bk, b);
+  }
+  release(&bk->lock);
+}
+
+// Release a buffer on behalf of the process that started an
+// asynchronous read of it.  Called by the disk driver when the
+// read is done, possibly from an interrupt, so it can't check
+// that the current process holds the buffer.
+void
+brelse_async(struct buf *b)
+{
+  struct bucket *bk;
+
+  releasesleep(&b->lock);
+
+  bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+  acquire(&bk->lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    bunlink(b);
+    bpush(bk, b);
+  }
+  release(&bk->lock);
+}
+
+/* Suma los contadores de todos los cubos. Sin cerrojos: sólo son estadísticas. */
+void
+bstat(struct iostat *st)
+{
+  struct bucket *bk;
+
+  st->nbuf = bcache.nbuf;
+  st->nreadahead = bcache.nahead;
+  st->bhits = st->bmisses = st->bevictions = 0;
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    st->bhits += bk->hits;
+    st->bmisses += bk->misses;
+    st->bevictions += bk->evictions;
+  }
 }
 //PAGEBREAK!
 // Blank page.
-
@@ -4,11 +4,20 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  struct buf *prev; // LRU cache list of its hash bucket
   struct buf *next;
   struct buf *qnext; // disk queue
-  uchar data[BSIZE];
+  uint64 qtime;      // rdtsc() when queued, then when sent to the disk
+  struct bbatch *batch; // completion group, see bsubmit()
+  uchar *data;       // BSIZE bytes carved from a kalloc() page
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_ASYNC 0x8  // submitted: driver calls brelse_async() when done
 
+
+// A group of bufs submitted with bsubmit(); bwait() sleeps
+// until all of them are done.
+struct bbatch {
+  int pending;      // bufs not yet done, protected by the disk driver
+};
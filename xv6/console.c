@@ -10,6 +10,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "file.h"
+#include "fcntl.h"
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
@@ -184,6 +185,7 @@ struct {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
+  struct pollq pollers;  // processes in poll() on the console
 } input;
 
 #define C(x)  ((x)-'@')  // Control-x
@@ -191,7 +193,7 @@ struct {
 void
 consoleintr(int (*getc)(void))
 {
-  int c, doprocdump = 0;
+  int c, doprocdump = 0, dolockstat = 0;
 
   acquire(&cons.lock);
   while((c = getc()) >= 0){
@@ -200,6 +202,10 @@ consoleintr(int (*getc)(void))
       // procdump() locks cons.lock indirectly; invoke later
       doprocdump = 1;
       break;
+    case C('T'):  // Lock statistics.
+      // Same as ^P: lockstatdump() prints via cons.lock.
+      dolockstat = 1;
+      break;
     case C('U'):  // Kill line.
       while(input.e != input.w &&
             input.buf[(input.e-1) % INPUT_BUF] != '\n'){
@@ -221,6 +227,8 @@ consoleintr(int (*getc)(void))
         if(c == '\n' || c == C('D') || input.e == input.r+INPUT_BUF){
           input.w = input.e;
           wakeup(&input.r);
+          if(input.pollers.head)
+            pollwakeup(&input.pollers);
         }
       }
       break;
@@ -230,6 +238,8 @@ consoleintr(int (*getc)(void))
   if(doprocdump) {
     procdump();  // now call procdump() wo. cons.lock held
   }
+  if(dolockstat)
+    lockstatdump();
 }
 
 int
@@ -285,6 +295,20 @@ consolewrite(struct inode *ip, char *buf, int n)
   return n;
 }
 
+// Input is ready once a whole line (or ^D) is in; output always.
+int
+consolepoll(struct inode *ip, struct pollent *e)
+{
+  int r;
+
+  if(e)
+    pollwait(&input.pollers, e);
+  acquire(&cons.lock);
+  r = POLLOUT | (input.r != input.w ? POLLIN : 0);
+  release(&cons.lock);
+  return r;
+}
+
 void
 consoleinit(void)
 {
@@ -292,6 +316,7 @@ consoleinit(void)
 
   devsw[CONSOLE].write = consolewrite;
   devsw[CONSOLE].read = consoleread;
+  devsw[CONSOLE].poll = consolepoll;
   cons.locking = 1;
 
   ioapicenable(IRQ_KBD, 0);
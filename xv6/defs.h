@@ -1,9 +1,17 @@
+struct bbatch;
 struct buf;
 struct context;
 struct file;
 struct inode;
+struct iostat;
+struct iovec;
+struct mm;
 struct pipe;
+struct pollent;
+struct pollfd;
+struct pollq;
 struct proc;
+struct shm;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
@@ -15,6 +23,13 @@ void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bstat(struct iostat*);
+void            breadahead(uint, uint);
+void            brelse_async(struct buf*);
+void            bsubmit(struct buf*, struct bbatch*);
+void            bpin(struct buf*);
+void            bunpin(struct buf*);
+void            bwait(struct bbatch*);
 
 // console.c
 void            consoleinit(void);
@@ -33,19 +48,29 @@ void            fileinit(void);
 int             fileread(struct file*, char*, int n);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filereadv(struct file*, struct iovec*, int, uint*);
+int             filewritev(struct file*, struct iovec*, int, uint*);
+int             fileseek(struct file*, int, int);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+int             dirunlink(struct inode*, char*, uint);
+void            fsstat(struct iostat*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
+void            ilock_shared(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
+void            iunlock_shared(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
+char*           ipin(struct inode*, uint);
+void            iunpin(struct inode*, uint);
+void            isync(struct inode*, uint);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
@@ -53,10 +78,18 @@ int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint, int);
+int             futexwake(uint, int);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            iderw_submit(struct buf*, struct bbatch*);
+void            iderw_wait(struct bbatch*);
+void            idestat(struct iostat*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -66,6 +99,8 @@ void            ioapicinit(void);
 // kalloc.c
 char*           kalloc(void);
 void            kfree(char*);
+void            kref(char*);
+int             krefcount(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 
@@ -78,6 +113,7 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(int, int);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
@@ -85,7 +121,10 @@ void            microdelay(int);
 void            initlog(int dev);
 void            log_write(struct buf*);
 void            begin_op();
+void            begin_opn(int);
 void            end_op();
+int             log_opmax(void);
+void            logstat(struct iostat*);
 
 // mp.c
 extern int      ismp;
@@ -95,26 +134,56 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// mmap.c
+int             mmap(uint, int, int, struct file*, uint);
+int             munmap(uint, uint);
+int             msync(uint, uint);
+int             vmafault(uint, int);
+uint            vmabase(struct proc*);
+void            vmaclear(struct proc*);
+int             vmadup(struct proc*, struct proc*);
+int             uvmcheck(uint, uint, int);
+int             shmat(int);
+int             shmdt(uint);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
+int             pipesetsize(struct pipe*, int);
+int             pipegetsize(struct pipe*);
+int             pipeempty(struct pipe*);
+int             pipefill(struct pipe*, struct file*, int);
+int             pipedrain(struct pipe*, struct file*, int);
+int             pipepoll(struct pipe*, int, struct pollent*);
+
+// poll.c
+void            pollinit(void);
+void            pollwait(struct pollq*, struct pollent*);
+void            pollwakeup(struct pollq*);
+void            polltick(void);
+int             poll(struct pollfd*, int, int);
 
 //PAGEBREAK: 16
 // proc.c
+int             clone(uint, uint, uint, uint);
 int             cpuid(void);
 
 /* --- Boletín 1. Ejercicio 3. --- */
 void            exit(int);
 
+struct cpu*     findcpu(void);
 int             fork(void);
 int             growproc(int);
+int             join(int, uint*);
 int             kill(int);
+int             kthread(char*, void(*)(void));
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
 void            procdump(void);
+void            procstat(struct iostat*);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
@@ -125,12 +194,23 @@ void            userinit(void);
 int             wait(int*);
 
 void            wakeup(void*);
+void            wakeproc(struct proc*, void*);
 void            yield(void);
 
 /* --- Boletín 3. Ejercicio 2. --- */
 enum proc_prio  getprio(int);
 int             setprio(int, enum proc_prio);
 
+// shm.c
+void            shminit(void);
+struct shm*     shmanon(uint);
+int             shmget(int, uint, int);
+int             shmctl(int, int);
+struct shm*     shmref(int, uint*);
+void            shmdup(struct shm*);
+void            shmput(struct shm*);
+char*           shmpage(struct shm*, uint);
+
 // swtch.S
 void            swtch(struct context**, struct context*);
 
@@ -142,12 +222,18 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
+void            lockstatdump(void);
+void            lockstatreset(void);
+void            lockbench(int, uint*);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
+void            acquiresleep_shared(struct sleeplock*);
+void            releasesleep_shared(struct sleeplock*);
+int             holdingsleep_shared(struct sleeplock*);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -161,6 +247,7 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, void**, int);
+int             argbuf(int, void**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
@@ -193,8 +280,14 @@ int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
+void            tlbshootdown(struct mm*);
+void            tlbintr(void);
+void            uvmunmap(pde_t*, struct mm*, uint, uint);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             cowfault(pde_t*, uint);
+char*           uvmshare(pde_t*, uint);
+int             uvmmap(pde_t*, uint, char*);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
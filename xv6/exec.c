@@ -3,6 +3,9 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
@@ -19,6 +22,10 @@ exec(char *path, char **argv)
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
 
+  // The other threads of the process would lose their memory.
+  if(curproc->mm->ref > 1)
+    return -1;
+
   begin_op();
 
   if((ip = namei(path)) == 0){
@@ -26,7 +33,8 @@ exec(char *path, char **argv)
     cprintf("exec: fail\n");
     return -1;
   }
-  ilock(ip);
+  /* El binario sólo se lee, así que varios exec() del mismo programa pueden cargarlo a la vez. */
+  ilock_shared(ip);
   pgdir = 0;
 
   // Check ELF header
@@ -56,7 +64,8 @@ exec(char *path, char **argv)
     if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
-  iunlockput(ip);
+  iunlock_shared(ip);
+  iput(ip);
   end_op();
   ip = 0;
 
@@ -94,9 +103,10 @@ exec(char *path, char **argv)
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
   // Commit to the user image.
+  vmaclear(curproc);
   oldpgdir = curproc->pgdir;
   curproc->pgdir = pgdir;
-  curproc->sz = sz;
+  curproc->mm->sz = sz;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
 
@@ -108,7 +118,8 @@ exec(char *path, char **argv)
   if(pgdir)
     freevm(pgdir, 1);
   if(ip){
-    iunlockput(ip);
+    iunlock_shared(ip);
+    iput(ip);
     end_op();
   }
   return -1;
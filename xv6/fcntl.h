@@ -2,3 +2,44 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+
+// lseek() whence
+#define SEEK_SET  0
+#define SEEK_CUR  1
+#define SEEK_END  2
+
+// A buffer of readv()/writev()
+struct iovec {
+  void *iov_base;
+  int iov_len;
+};
+
+// mmap() protection and flags
+#define PROT_READ    0x1
+#define PROT_WRITE   0x2
+#define MAP_SHARED   0x1  // writes reach the file, and children share the pages
+#define MAP_PRIVATE  0x2  // a private copy
+#define MAP_ANON     0x4  // zeroed memory, no file
+#define MAP_FAILED   ((void*)-1)
+
+// shmget() keys and flags, shmctl() commands
+#define IPC_PRIVATE  0      // a new segment, without a key
+#define IPC_CREAT    0x200  // create the segment if there is none
+#define IPC_EXCL     0x400  // with IPC_CREAT: fail if it exists
+#define IPC_RMID     0      // remove the segment
+
+// fcntl() commands
+#define F_GETPIPE_SZ  1  // size of a pipe's buffer
+#define F_SETPIPE_SZ  2  // resize a pipe's buffer, returns the new size
+
+// A file descriptor for poll(), and its events
+struct pollfd {
+  int fd;         // ignored if negative
+  short events;   // events wanted
+  short revents;  // events that happened
+};
+#define POLLIN    0x01  // there is data to read
+#define POLLOUT   0x04  // writing will not block
+#define POLLERR   0x08  // a pipe without readers (always reported)
+#define POLLHUP   0x10  // a pipe without writers (always reported)
+#define POLLNVAL  0x20  // fd is not open (always reported)
@@ -5,10 +5,12 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "stat.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "fcntl.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -84,74 +86,207 @@ int
 filestat(struct file *f, struct stat *st)
 {
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    ilock_shared(f->ip);
     stati(f->ip, st);
-    iunlock(f->ip);
+    iunlock_shared(f->ip);
     return 0;
   }
   return -1;
 }
 
-// Read from file f.
+// Read into the n buffers of iov from ip at *off, advancing *off.
+// Stops at the first short read. Caller holds ip->lock.
+static int
+readiv(struct inode *ip, struct iovec *iov, int n, uint *off)
+{
+  int i, r, tot;
+
+  tot = 0;
+  for(i = 0; i < n; i++){
+    if((r = readi(ip, iov[i].iov_base, *off, iov[i].iov_len)) < 0)
+      return tot > 0 ? tot : -1;
+    *off += r;
+    tot += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  return tot;
+}
+
+// Read from file f into the n buffers of iov, in order. If off is
+// not 0, read at *off and leave f->off alone (pread()).
 int
-fileread(struct file *f, char *addr, int n)
+filereadv(struct file *f, struct iovec *iov, int n, uint *off)
 {
-  int r;
+  int i, r, tot;
+  uint o;
 
   if(f->readable == 0)
     return -1;
-  if(f->type == FD_PIPE)
-    return piperead(f->pipe, addr, n);
+  if(f->type == FD_PIPE){
+    if(off)
+      return -1;
+    // Don't wait for more data once some has been read.
+    tot = 0;
+    for(i = 0; i < n; i++){
+      if(i > 0 && pipeempty(f->pipe))
+        break;
+      if((r = piperead(f->pipe, iov[i].iov_base, iov[i].iov_len)) < 0)
+        return tot > 0 ? tot : -1;
+      tot += r;
+      if(r < iov[i].iov_len)
+        break;
+    }
+    return tot;
+  }
   if(f->type == FD_INODE){
+    /* Si el fichero abierto no está compartido nadie más puede mover f->off, así que basta con el inodo en modo compartido y los lectores de un mismo fichero no se esperan entre sí. Con pread() no se toca f->off, así que da igual que esté compartido. Los dispositivos (consola) sueltan y retoman el cerrojo en exclusiva dentro de read. */
+    if(off || f->ref == 1){
+      ilock_shared(f->ip);
+      if(f->ip->type != T_DEV){
+        o = off ? *off : f->off;
+        r = readiv(f->ip, iov, n, &o);
+        if(!off)
+          f->off = o;
+        iunlock_shared(f->ip);
+        return r;
+      }
+      iunlock_shared(f->ip);
+    }
     ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
-      f->off += r;
+    r = readiv(f->ip, iov, n, off ? off : &f->off);
     iunlock(f->ip);
     return r;
   }
   panic("fileread");
 }
 
+// Read from file f.
+int
+fileread(struct file *f, char *addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return filereadv(f, &iov, 1, 0);
+}
+
 //PAGEBREAK!
-// Write to file f.
+// Write the n buffers of iov to file f, in order. If off is not 0,
+// write at *off and leave f->off alone (pwrite()).
 int
-filewrite(struct file *f, char *addr, int n)
+filewritev(struct file *f, struct iovec *iov, int n, uint *off)
 {
-  int r;
+  int i, r, m, n1, tot, done;
 
   if(f->writable == 0)
     return -1;
-  if(f->type == FD_PIPE)
-    return pipewrite(f->pipe, addr, n);
+  tot = 0;
+  for(i = 0; i < n; i++)
+    tot += iov[i].iov_len;
+  if(f->type == FD_PIPE){
+    if(off)
+      return -1;
+    for(i = 0; i < n; i++)
+      if(pipewrite(f->pipe, iov[i].iov_base, iov[i].iov_len) < 0)
+        return -1;
+    return tot;
+  }
   if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
+    // write as many blocks at a time as one log transaction
+    // may take, declaring the i-node, the indirect blocks
+    // (up to NINDIRECT data blocks touch at most 3 of them),
+    // allocation bitmap blocks and 1 block of slop for
+    // non-aligned writes besides the data blocks.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
+    // The buffers are written one after the other, so a
+    // transaction covers consecutive bytes of the file
+    // whichever buffers they come from.
+    int max = (log_opmax()-1-3-NBITMAP-1) * BSIZE;
+    if(max > NINDIRECT * BSIZE)
+      max = NINDIRECT * BSIZE;
+    if(off == 0)
+      off = &f->off;
+    i = 0;      // current buffer
+    m = 0;      // bytes of it already written
+    done = 0;
+    r = 0;
+    while(done < tot){
+      n1 = tot - done;
       if(n1 > max)
         n1 = max;
 
-      begin_op();
+      begin_opn((n1+BSIZE-1)/BSIZE + 1+3+NBITMAP+1);
       ilock(f->ip);
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
-        f->off += r;
+      while(n1 > 0){
+        if(m == iov[i].iov_len){
+          i++;
+          m = 0;
+          continue;
+        }
+        r = iov[i].iov_len - m;
+        if(r > n1)
+          r = n1;
+        // A device may write nothing: stop rather than spin.
+        if((r = writei(f->ip, (char*)iov[i].iov_base + m, *off, r)) <= 0)
+          break;
+        *off += r;
+        m += r;
+        n1 -= r;
+        done += r;
+      }
       iunlock(f->ip);
       end_op();
 
-      if(r < 0)
+      if(r <= 0)
         break;
-      if(r != n1)
+      if(n1 != 0)
         panic("short filewrite");
-      i += r;
     }
-    return i == n ? n : -1;
+    return done == tot ? tot : -1;
   }
   panic("filewrite");
 }
 
+// Write to file f.
+int
+filewrite(struct file *f, char *addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return filewritev(f, &iov, 1, 0);
+}
+
+// Set the offset of file f as lseek() does. Returns the new offset.
+int
+fileseek(struct file *f, int off, int whence)
+{
+  int base;
+
+  if(f->type != FD_INODE)
+    return -1;
+  switch(whence){
+  case SEEK_SET:
+    base = 0;
+    break;
+  case SEEK_CUR:
+    base = f->off;
+    break;
+  case SEEK_END:
+    ilock_shared(f->ip);
+    base = f->ip->size;
+    iunlock_shared(f->ip);
+    break;
+  default:
+    return -1;
+  }
+  if(base + off < 0)
+    return -1;
+  f->off = base + off;
+  return f->off;
+}
+
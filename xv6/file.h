@@ -14,15 +14,41 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  /* Cadena de la tabla hash de icache y lista LRU de entradas sin referencias, protegidas por icache.lock. */
+  struct inode *hnext;
+  struct inode *fprev, *fnext;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
+  /* Estado de la lectura adelantada (ver readahead() en fs.c). Es sólo una heurística, así que se actualiza también con el cerrojo en modo compartido. */
+  uint ranext;        // Bloque que leería un acceso secuencial.
+  uint raend;         // Primer bloque aún no pedido por adelantado.
+  uint rawin;         // Tamaño actual de la ventana, en bloques.
+  uint lastb;         // Último bloque de disco devuelto por bmap(): los nuevos se buscan a continuación.
+
+  /* Último bloque indirecto usado por bmap(), fijado en el buffer cache con bpin(). Con el cerrojo compartido bmap() sólo lee, así que basta con proteger estos campos con bmlock. */
+  struct spinlock bmlock;
+  struct buf *ind;    // Buffer del bloque indirecto, o 0.
+  uint indbase;       // Primer bloque del fichero que direcciona.
+
   short type;         // copy of disk inode
   short major;
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
+};
+
+// Processes in poll() waiting for something to change in a pipe
+// or device: each has a pollent on its queue (see poll.c).
+struct pollq {
+  struct pollent *head;
+};
+
+struct pollent {
+  struct poller *pl;   // the process polling
+  struct pollq *q;     // queue it is on, or 0
+  struct pollent *next;
 };
 
 // table mapping major device number to
@@ -30,6 +56,7 @@ struct inode {
 struct devsw {
   int (*read)(struct inode*, char*, int);
   int (*write)(struct inode*, char*, int);
+  int (*poll)(struct inode*, struct pollent*);  // 0: always ready
 };
 
 extern struct devsw devsw[];
@@ -15,14 +15,19 @@
 #include "stat.h"
 #include "mmu.h"
 #include "proc.h"
+#include "x86.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "iostat.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
+static void bmapcache(struct inode*, struct buf*, uint);
+static void dcacheinit(void);
+static void dcacheput(struct inode*, char*, uint, uint);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -52,25 +57,93 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// In-memory summary of the free bitmap: how many blocks each
+// bitmap block still has free, so balloc() skips full ones
+// without reading them.  nfree[i] only changes while bitmap
+// block i is locked; readers may see a stale count, which just
+// costs a wasted look.  cursor is a hint, read and written
+// without a lock.
+struct {
+  uint n;          // bitmap blocks
+  uint *nfree;     // per bitmap block, a kalloc()ed page
+  uint cursor;     // next-fit: just past the last allocation
+} fsmap;
+
+// Count the free blocks of every bitmap block.
+static void
+fsmapinit(int dev)
+{
+  uint i, w, x, b;
+  struct buf *bp;
+
+  fsmap.n = (sb.size + BPB - 1) / BPB;
+  if(fsmap.n > PGSIZE / sizeof(uint) || (fsmap.nfree = (uint*)kalloc()) == 0)
+    panic("fsmapinit");
+  for(i = 0; i < fsmap.n; i++){
+    bp = bread(dev, sb.bmapstart + i);
+    fsmap.nfree[i] = 0;
+    for(w = 0; w < BPB/32; w++){
+      b = i*BPB + w*32;
+      if(b >= sb.size)
+        break;
+      x = ~((uint*)bp->data)[w];
+      if(sb.size - b < 32)
+        x &= (1 << (sb.size - b)) - 1;
+      for(; x; x &= x - 1)
+        fsmap.nfree[i]++;
+    }
+    brelse(bp);
+  }
+}
+
+// Find a clear bit at or after bit start in bitmap block bp,
+// which is bitmap block number bb, a word at a time.
+// Returns the block number, or 0 if there is none.
+static uint
+bfind(struct buf *bp, uint bb, uint start)
+{
+  uint w, x, b;
+
+  w = start / 32;
+  x = ((uint*)bp->data)[w] | ((1 << (start % 32)) - 1);
+  for(;;){
+    if(x != 0xffffffff){
+      b = bb*BPB + w*32 + bsf(~x);
+      return b < sb.size ? b : 0;
+    }
+    if(++w == BPB/32)
+      return 0;
+    x = ((uint*)bp->data)[w];
+  }
+}
+
+// Allocate a zeroed disk block, the first free one at or after
+// goal if possible (0: continue where the last allocation ended).
 static uint
-balloc(uint dev)
+balloc(uint dev, uint goal)
 {
-  int b, bi, m;
+  uint i, bb, b;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+  if(goal == 0 || goal >= sb.size)
+    goal = fsmap.cursor;
+  if(goal >= sb.size)
+    goal = 0;
+  // Start in goal's bitmap block; come back to it at the end
+  // to search the part before goal.
+  for(i = 0; i <= fsmap.n; i++){
+    bb = (goal / BPB + i) % fsmap.n;
+    if(fsmap.nfree[bb] == 0)
+      continue;
+    bp = bread(dev, sb.bmapstart + bb);
+    if((b = bfind(bp, bb, i == 0 ? goal % BPB : 0)) != 0){
+      bp->data[(b % BPB)/8] |= 1 << (b % 8);  // Mark block in use.
+      log_write(bp);
+      fsmap.nfree[bb]--;
+      brelse(bp);
+      fsmap.cursor = b + 1;
+      bzero(dev, b);
+      return b;
     }
     brelse(bp);
   }
@@ -84,7 +157,6 @@ bfree(int dev, uint b)
   struct buf *bp;
   int bi, m;
 
-  readsb(dev, &sb);
   bp = bread(dev, BBLOCK(b, sb));
   bi = b % BPB;
   m = 1 << (bi % 8);
@@ -92,6 +164,7 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+  fsmap.nfree[b / BPB]++;
   brelse(bp);
 }
 
@@ -163,27 +236,72 @@ bfree(int dev, uint b)
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
+//
+// ilock_shared() takes ip->lock in shared mode: several processes
+// may then read the inode and its content at once (readi() of
+// fileread(), exec() and namex()), but none may modify it.
+//
+// Every entry that holds an inode is on the hash chain of its
+// (dev, inum), and entries with ref == 0 are also on an LRU list.
+// Such an entry keeps its identity and its valid copy of the disk
+// inode until iget() recycles it, so reopening a file recently
+// closed does not read the inode block again.
+
+#define NIHASH 61
 
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct inode *hash[NIHASH];
+  struct inode free;      // LRU list of unreferenced entries; free.fnext is the oldest
+  uint hits;
+  uint misses;
 } icache;
 
+static struct inode**
+ihash(uint dev, uint inum)
+{
+  return &icache.hash[(dev * 31 + inum) % NIHASH];
+}
+
+// Take ip off the LRU list. Caller holds icache.lock.
+static void
+ifreeremove(struct inode *ip)
+{
+  ip->fprev->fnext = ip->fnext;
+  ip->fnext->fprev = ip->fprev;
+}
+
+// Put ip at the recent end of the LRU list. Caller holds icache.lock.
+static void
+ifreeappend(struct inode *ip)
+{
+  ip->fnext = &icache.free;
+  ip->fprev = icache.free.fprev;
+  icache.free.fprev->fnext = ip;
+  icache.free.fprev = ip;
+}
+
 void
 iinit(int dev)
 {
   int i = 0;
   
   initlock(&icache.lock, "icache");
+  icache.free.fnext = icache.free.fprev = &icache.free;
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&icache.inode[i].lock, "inode");
+    initlock(&icache.inode[i].bmlock, "bmap");
+    ifreeappend(&icache.inode[i]);
   }
+  dcacheinit();
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
  inodestart %d bmap start %d\n", sb.size, sb.nblocks,
           sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
           sb.bmapstart);
+  fsmapinit(dev);
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -242,31 +360,47 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
 
   acquire(&icache.lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = *ihash(dev, inum); ip != 0; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        ifreeremove(ip);
+      icache.hits++;
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
+  // Recycle the least recently used inode cache entry.
+  ip = icache.free.fnext;
+  if(ip == &icache.free)
     panic("iget: no inodes");
+  ifreeremove(ip);
+  if(ip->ind)
+    panic("iget: indirect block still cached");
+  if(ip->inum != 0){
+    for(pp = ihash(ip->dev, ip->inum); *pp != ip; pp = &(*pp)->hnext)
+      ;
+    *pp = ip->hnext;
+  }
+  icache.misses++;
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
+  pp = ihash(dev, inum);
+  ip->hnext = *pp;
+  *pp = ip;
   ip->ref = 1;
   ip->valid = 0;
+  ip->ranext = 0;
+  ip->raend = 0;
+  ip->rawin = 0;
+  ip->lastb = 0;
+  ip->indbase = 0;
   release(&icache.lock);
 
   return ip;
@@ -322,6 +456,33 @@ iunlock(struct inode *ip)
   releasesleep(&ip->lock);
 }
 
+/* Bloquea el inodo en modo compartido, sólo para leerlo. Si no está cargado hay que leerlo del disco, lo que modifica el inodo; eso se hace con ilock() en exclusiva y se vuelve a intentar. */
+void
+ilock_shared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilock_shared");
+
+  for(;;){
+    acquiresleep_shared(&ip->lock);
+    if(ip->valid)
+      return;
+    releasesleep_shared(&ip->lock);
+    /* Tenemos una referencia, así que iput() no lo invalidará entre medias. */
+    ilock(ip);
+    iunlock(ip);
+  }
+}
+
+void
+iunlock_shared(struct inode *ip)
+{
+  if(ip == 0 || !holdingsleep_shared(&ip->lock) || ip->ref < 1)
+    panic("iunlock_shared");
+
+  releasesleep_shared(&ip->lock);
+}
+
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode cache entry can
 // be recycled.
@@ -339,6 +500,11 @@ iput(struct inode *ip)
     release(&icache.lock);
     if(r == 1){
       // inode has no links and no other references: truncate and free.
+      if(ip->type == T_DIR){
+        // Forget "." and ".." before the inum can name a new directory.
+        dcacheput(ip, ".", 0, 0);
+        dcacheput(ip, "..", 0, 0);
+      }
       itrunc(ip);
       ip->type = 0;
       iupdate(ip);
@@ -348,7 +514,17 @@ iput(struct inode *ip)
   releasesleep(&ip->lock);
 
   acquire(&icache.lock);
-  ip->ref--;
+  // Unpin the cached indirect block before iget() can recycle
+  // the entry for another inode.  While icache.lock is released
+  // someone may iget() the inode and bmap() through it, caching
+  // a block again: check once more with the lock held.
+  while(ip->ref == 1 && ip->ind){
+    release(&icache.lock);
+    bmapcache(ip, 0, 0);
+    acquire(&icache.lock);
+  }
+  if(--ip->ref == 0)
+    ifreeappend(ip);
   release(&icache.lock);
 }
 
@@ -366,40 +542,146 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT].  The last NDINDIRECT
+// are listed in the indirect blocks that block
+// ip->addrs[NDIRECT+1] lists.
+
+// Allocate a block for ip right after the last one bmap()
+// returned, so that files end up contiguous on disk.
+static uint
+bmapalloc(struct inode *ip)
+{
+  return balloc(ip->dev, ip->lastb ? ip->lastb + 1 : 0);
+}
+
+// Make bp, the indirect block listing the file blocks from
+// base on, the one cached in ip (0 drops the cached one).
+static void
+bmapcache(struct inode *ip, struct buf *bp, uint base)
+{
+  struct buf *old;
+
+  acquire(&ip->bmlock);
+  old = ip->ind;
+  if(old == bp){
+    release(&ip->bmlock);
+    return;
+  }
+  if(bp)
+    bpin(bp);
+  ip->ind = bp;
+  ip->indbase = base;
+  release(&ip->bmlock);
+  if(old)
+    bunpin(old);
+}
+
+// Look file block bn up in the cached indirect block.
+// Returns 0 if it is not there.
+static uint
+bmapcached(struct inode *ip, uint bn)
+{
+  uint addr;
+
+  addr = 0;
+  acquire(&ip->bmlock);
+  if(ip->ind && bn >= ip->indbase && bn < ip->indbase + NINDIRECT)
+    addr = ((uint*)ip->ind->data)[bn - ip->indbase];
+  release(&ip->bmlock);
+  return addr;
+}
+
+// Return entry i of indirect block ind, which lists the file
+// blocks from base on, allocating the data block if necessary.
+static uint
+bmapind(struct inode *ip, uint ind, uint i, uint base)
+{
+  uint addr, *a;
+  struct buf *bp;
+
+  bp = bread(ip->dev, ind);
+  a = (uint*)bp->data;
+  if((addr = a[i]) == 0){
+    a[i] = addr = bmapalloc(ip);
+    log_write(bp);
+  }
+  bmapcache(ip, bp, base);
+  brelse(bp);
+  return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
+// Readers holding ip->lock shared never make it allocate, and
+// the indirect blocks only change under the exclusive lock, so
+// the cached one can be read without locking its buffer.
 static uint
-bmap(struct inode *ip, uint bn)
+bmap1(struct inode *ip, uint bn)
 {
   uint addr, *a;
   struct buf *bp;
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = bmapalloc(ip);
     return addr;
   }
+  if((addr = bmapcached(ip, bn)) != 0)
+    return addr;
   bn -= NDIRECT;
 
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = bmapalloc(ip);
+    return bmapind(ip, addr, bn, NDIRECT);
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load doubly-indirect block, then the indirect block
+    // it lists, allocating if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0)
+      ip->addrs[NDIRECT+1] = addr = bmapalloc(ip);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+    if((addr = a[bn/NINDIRECT]) == 0){
+      a[bn/NINDIRECT] = addr = bmapalloc(ip);
       log_write(bp);
     }
     brelse(bp);
-    return addr;
+    return bmapind(ip, addr, bn%NINDIRECT,
+                   NDIRECT + NINDIRECT + bn/NINDIRECT*NINDIRECT);
   }
 
   panic("bmap: out of range");
 }
 
+static uint
+bmap(struct inode *ip, uint bn)
+{
+  // Only a hint, so readers update it too.
+  return ip->lastb = bmap1(ip, bn);
+}
+
+// Free indirect block addr and the data blocks it lists.
+static void
+itruncind(struct inode *ip, uint addr)
+{
+  int j;
+  struct buf *bp;
+  uint *a;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j])
+      bfree(ip->dev, a[j]);
+  }
+  brelse(bp);
+  bfree(ip->dev, addr);
+}
+
 // Truncate inode (discard contents).
 // Only called when the inode has no links
 // to it (no directory entries referring to it)
@@ -412,6 +694,8 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  bmapcache(ip, 0, 0);
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -420,15 +704,20 @@ itrunc(struct inode *ip)
   }
 
   if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
+    itruncind(ip, ip->addrs[NDIRECT]);
+    ip->addrs[NDIRECT] = 0;
+  }
+
+  if(ip->addrs[NDIRECT+1]){
+    bp = bread(ip->dev, ip->addrs[NDIRECT+1]);
     a = (uint*)bp->data;
     for(j = 0; j < NINDIRECT; j++){
       if(a[j])
-        bfree(ip->dev, a[j]);
+        itruncind(ip, a[j]);
     }
     brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
+    bfree(ip->dev, ip->addrs[NDIRECT+1]);
+    ip->addrs[NDIRECT+1] = 0;
   }
 
   ip->size = 0;
@@ -447,9 +736,45 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Read-ahead window limits, in blocks.
+#define RAMIN 4
+#define RAMAX 64
+
+/* Lectura adelantada. Si el bloque bn es el siguiente al último leído, el acceso es secuencial y se piden al disco sin esperar los bloques siguientes, duplicando la ventana mientras siga siéndolo. Un acceso no secuencial la anula. Como sólo se miran bloques por debajo de ip->size, bmap() nunca reserva bloques aquí. */
+static void
+readahead(struct inode *ip, uint bn)
+{
+  uint b, end, nblocks;
+
+  if(bn != ip->ranext){
+    ip->ranext = bn + 1;
+    ip->raend = 0;
+    ip->rawin = 0;
+    return;
+  }
+  ip->ranext = bn + 1;
+
+  // Still far enough ahead of the reader?
+  if(ip->raend > bn + ip->rawin/2)
+    return;
+
+  if(ip->rawin == 0)
+    ip->rawin = RAMIN;
+  else if(ip->rawin < RAMAX)
+    ip->rawin *= 2;
+
+  nblocks = (ip->size + BSIZE - 1) / BSIZE;
+  end = min(bn + 1 + ip->rawin, nblocks);
+  for(b = ip->raend > bn ? ip->raend : bn + 1; b < end; b++)
+    breadahead(ip->dev, bmap(ip, b));
+  if(end > ip->raend)
+    ip->raend = end;
+}
+
 //PAGEBREAK!
 // Read data from inode.
-// Caller must hold ip->lock.
+// Caller must hold ip->lock, in shared mode at least.
+// Never allocates blocks: every block below ip->size exists.
 int
 readi(struct inode *ip, char *dst, uint off, uint n)
 {
@@ -469,6 +794,9 @@ readi(struct inode *ip, char *dst, uint off, uint n)
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    // Several reads of the same block count as one access.
+    if(off/BSIZE + 1 != ip->ranext || off%BSIZE == 0)
+      readahead(ip, off/BSIZE);
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(dst, bp->data + off%BSIZE, m);
     brelse(bp);
@@ -476,6 +804,49 @@ readi(struct inode *ip, char *dst, uint off, uint n)
   return n;
 }
 
+// Pin the buffer of the block at byte off of ip, which must be
+// block-aligned, in the cache and return its data, to be mapped
+// by a shared mmap().  Returns 0 if off is past the end of the
+// file.  Caller must hold ip->lock.
+char*
+ipin(struct inode *ip, uint off)
+{
+  struct buf *bp;
+  char *data;
+
+  if(off >= ip->size || off % BSIZE != 0)
+    return 0;
+  bp = bread(ip->dev, bmap(ip, off/BSIZE));
+  bpin(bp);
+  data = (char*)bp->data;
+  brelse(bp);
+  return data;
+}
+
+// Drop a pin taken by ipin().  Caller must hold ip->lock.
+void
+iunpin(struct inode *ip, uint off)
+{
+  struct buf *bp;
+
+  bp = bread(ip->dev, bmap(ip, off/BSIZE));
+  bunpin(bp);
+  brelse(bp);
+}
+
+// Log the block at byte off of ip, modified through a shared
+// mmap(), as written.  Caller must be in a transaction and hold
+// ip->lock.
+void
+isync(struct inode *ip, uint off)
+{
+  struct buf *bp;
+
+  bp = bread(ip->dev, bmap(ip, off/BSIZE));
+  log_write(bp);
+  brelse(bp);
+}
+
 // PAGEBREAK!
 // Write data to inode.
 // Caller must hold ip->lock.
@@ -493,7 +864,7 @@ writei(struct inode *ip, char *src, uint off, uint n)
 
   if(off > ip->size || off + n < off)
     return -1;
-  if(off + n > MAXFILE*BSIZE)
+  if((uint64)off + n > (uint64)MAXFILE*BSIZE)
     return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
@@ -520,41 +891,415 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Directory name lookup cache. Maps (dev, directory inum, name)
+// to the inum and byte offset of the entry, or to inum 0 if the
+// directory has no such name. Directories only change through
+// dirlink() and dirunlink(), which update the cache while holding
+// the directory's lock, so an entry never goes stale. A directory
+// that is freed has nothing but "." and ".." left in it; iput()
+// forgets those, and every other name is correctly absent if the
+// inum is reused for a new directory.
+
+#define NDHASH 61
+
+struct dentry {
+  uint dev;
+  uint dir;             // inum of the directory; 0 if the entry is unused
+  char name[DIRSIZ];
+  uint inum;            // 0: name not present
+  uint off;
+  struct dentry *hnext;
+  struct dentry *prev;  // LRU list
+  struct dentry *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry dentry[NDCACHE];
+  struct dentry *hash[NDHASH];
+  struct dentry head;   // head.next is the most recently used
+  uint hits;
+  uint misses;
+} dcache;
+
+static void
+dcacheinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.head.prev = dcache.head.next = &dcache.head;
+  for(d = dcache.dentry; d < dcache.dentry+NDCACHE; d++){
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+  }
+}
+
+static struct dentry**
+dhash(uint dev, uint dir, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev * 31 + dir;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return &dcache.hash[h % NDHASH];
+}
+
+// Move d to the front of the LRU list. Caller holds dcache.lock.
+static void
+dtouch(struct dentry *d)
+{
+  d->next->prev = d->prev;
+  d->prev->next = d->next;
+  d->next = dcache.head.next;
+  d->prev = &dcache.head;
+  dcache.head.next->prev = d;
+  dcache.head.next = d;
+}
+
+// Find the cache entry of name in dp. Caller holds dcache.lock.
+static struct dentry*
+dget(struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  for(d = *dhash(dp->dev, dp->inum, name); d != 0; d = d->hnext)
+    if(d->dev == dp->dev && d->dir == dp->inum && namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+// Record that name in dp is inum at offset off (inum 0: absent).
+static void
+dcacheput(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dentry *d, **pp;
+
+  acquire(&dcache.lock);
+  if((d = dget(dp, name)) == 0){
+    // Recycle the least recently used entry.
+    d = dcache.head.prev;
+    if(d->dir != 0){
+      for(pp = dhash(d->dev, d->dir, d->name); *pp != d; pp = &(*pp)->hnext)
+        ;
+      *pp = d->hnext;
+    }
+    d->dev = dp->dev;
+    d->dir = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+    pp = dhash(d->dev, d->dir, d->name);
+    d->hnext = *pp;
+    *pp = d;
+  }
+  d->inum = inum;
+  d->off = off;
+  dtouch(d);
+  release(&dcache.lock);
+}
+
+// Indexed directories (see fs.h). A linear directory becomes
+// indexed when it fills its first block; from then on a name is
+// found by hashing it, searching the index in block 0 and scanning
+// the one leaf block that covers the hash.
+
+#define DXHEAD(bp)  ((struct dxhead*)((struct dirent*)(bp)->data + 2))
+#define DXENT(bp)   ((struct dxentry*)((struct dirent*)(bp)->data + 3))
+#define DPB         (BSIZE / sizeof(struct dirent))
+
+// FNV-1a hash of a name. mkfs has a copy.
+static uint
+dxhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261U;
+  for(i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+// Return a locked buffer with block 0 of dp if dp is indexed, else 0.
+static struct buf*
+dxread(struct inode *dp)
+{
+  struct buf *bp;
+  struct dxhead *hd;
+
+  if(dp->size < 2*BSIZE)
+    return 0;
+  bp = bread(dp->dev, bmap(dp, 0));
+  hd = DXHEAD(bp);
+  if(hd->inum != 0 || hd->magic != DXMAGIC || hd->n < 1 || hd->n > DXMAX){
+    brelse(bp);
+    return 0;
+  }
+  return bp;
+}
+
+// Index slot of the leaf that covers hash h: the last one whose
+// starting hash is not above h. Slot 0 starts at hash 0.
+static int
+dxsearch(struct buf *bp, uint h)
+{
+  struct dxentry *e;
+  int lo, hi, mid;
+
+  e = DXENT(bp);
+  lo = 0;
+  hi = DXHEAD(bp)->n - 1;
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(e[mid].hash <= h)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+// Look for name among the entries of block bn of dp.
+// Return its inum and set *poff, or return 0.
+static uint
+dirblock(struct inode *dp, uint bn, char *name, uint *poff)
+{
+  struct buf *bp;
+  struct dirent *de;
+  uint i, inum;
+
+  bp = bread(dp->dev, bmap(dp, bn));
+  de = (struct dirent*)bp->data;
+  for(i = 0; i < DPB && bn*BSIZE + i*sizeof(*de) < dp->size; i++){
+    if(de[i].inum != 0 && namecmp(name, de[i].name) == 0){
+      inum = de[i].inum;
+      *poff = bn*BSIZE + i*sizeof(*de);
+      brelse(bp);
+      return inum;
+    }
+  }
+  brelse(bp);
+  return 0;
+}
+
+// Look for name in dp, bypassing the name cache.
+static uint
+dirfind(struct inode *dp, char *name, uint *poff)
+{
+  struct buf *bp;
+  uint bn, inum;
+
+  if((bp = dxread(dp)) != 0){
+    // "." and ".." stay in block 0.
+    bn = 0;
+    if(namecmp(name, ".") != 0 && namecmp(name, "..") != 0)
+      bn = DXENT(bp)[dxsearch(bp, dxhash(name))].block;
+    brelse(bp);
+    return dirblock(dp, bn, name, poff);
+  }
+
+  for(bn = 0; bn*BSIZE < dp->size; bn++)
+    if((inum = dirblock(dp, bn, name, poff)) != 0)
+      return inum;
+  return 0;
+}
+
+// The entry for name in dp has moved to offset off.
+static void
+dcachemoved(struct inode *dp, char *name, uint off)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dget(dp, name)) != 0)
+    d->off = off;
+  release(&dcache.lock);
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Caller must hold dp's lock, in shared mode at least.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
   uint off, inum;
-  struct dirent de;
+  struct dentry *d;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
-      continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
-    }
+  off = 0;
+  acquire(&dcache.lock);
+  if((d = dget(dp, name)) != 0){
+    dtouch(d);
+    dcache.hits++;
+    inum = d->inum;
+    off = d->off;
+    release(&dcache.lock);
+  } else {
+    dcache.misses++;
+    release(&dcache.lock);
+    inum = dirfind(dp, name, &off);
+    dcacheput(dp, name, inum, off);
+  }
+
+  if(inum == 0)
+    return 0;
+  if(poff)
+    *poff = off;
+  return iget(dp->dev, inum);
+}
+
+// Turn the linear directory dp, whose only block is full, into an
+// indexed directory with a single leaf. Returns -1 if block 0 does
+// not start with "." and "..", so the directory must stay linear.
+static int
+dxinit(struct inode *dp)
+{
+  struct buf *bp, *lp;
+  struct dirent *de;
+  struct dxhead *hd;
+  struct dxentry *e;
+  int i;
+
+  bp = bread(dp->dev, bmap(dp, 0));
+  de = (struct dirent*)bp->data;
+  if(namecmp(de[0].name, ".") != 0 || namecmp(de[1].name, "..") != 0){
+    brelse(bp);
+    return -1;
   }
+  lp = bread(dp->dev, bmap(dp, 1));
+  memset(lp->data, 0, BSIZE);
+  memmove(lp->data, de + 2, BSIZE - 2*sizeof(*de));
+  for(i = 2; i < DPB; i++)
+    dcachemoved(dp, de[i].name, BSIZE + (i-2)*sizeof(*de));
+  log_write(lp);
+  brelse(lp);
+
+  memset(de + 2, 0, BSIZE - 2*sizeof(*de));
+  hd = DXHEAD(bp);
+  hd->magic = DXMAGIC;
+  hd->n = 1;
+  e = DXENT(bp);
+  e[0].hash = 0;
+  e[0].block = 1;
+  log_write(bp);
+  brelse(bp);
 
+  dp->size = 2*BSIZE;
+  iupdate(dp);
   return 0;
 }
 
+// Return the offset of a free entry in block bn of dp, or -1.
+static int
+dirfree(struct inode *dp, uint bn)
+{
+  struct buf *bp;
+  struct dirent *de;
+  int i;
+
+  bp = bread(dp->dev, bmap(dp, bn));
+  de = (struct dirent*)bp->data;
+  for(i = 0; i < DPB; i++)
+    if(de[i].inum == 0)
+      break;
+  brelse(bp);
+  if(i == DPB)
+    return -1;
+  return bn*BSIZE + i*sizeof(*de);
+}
+
+// Return the offset of a free entry for name in the indexed
+// directory dp, whose block 0 is bp, splitting the leaf that covers
+// name's hash if it is full. Returns -1 if the index is full or the
+// leaf cannot be split because all its names have the same hash.
+// Releases bp.
+static int
+dxlink(struct inode *dp, struct buf *bp, char *name)
+{
+  struct buf *lp, *np;
+  struct dirent *de, *nde;
+  struct dxhead *hd;
+  struct dxentry *e;
+  uint h, s, hs[DPB], lb, nb;
+  int i, j, k;
+
+  h = dxhash(name);
+  i = dxsearch(bp, h);
+  hd = DXHEAD(bp);
+  e = DXENT(bp);
+  if((k = dirfree(dp, e[i].block)) >= 0 || hd->n == DXMAX){
+    brelse(bp);
+    return k;
+  }
+
+  // Split the leaf at the median hash: the entries at or above it
+  // move to a new leaf at the end of the directory.
+  lb = e[i].block;
+  lp = bread(dp->dev, bmap(dp, lb));
+  de = (struct dirent*)lp->data;
+  for(j = 0; j < DPB; j++){
+    s = dxhash(de[j].name);
+    for(k = j; k > 0 && hs[k-1] > s; k--)
+      hs[k] = hs[k-1];
+    hs[k] = s;
+  }
+  s = hs[DPB/2];
+  for(k = DPB/2; k < DPB && hs[k] == hs[0]; k++)
+    ;
+  if(k == DPB){
+    brelse(lp);
+    brelse(bp);
+    return -1;
+  }
+  if(s == hs[0])
+    s = hs[k];
+
+  nb = dp->size / BSIZE;
+  np = bread(dp->dev, bmap(dp, nb));
+  memset(np->data, 0, BSIZE);
+  nde = (struct dirent*)np->data;
+  for(j = k = 0; j < DPB; j++){
+    if(dxhash(de[j].name) >= s){
+      dcachemoved(dp, de[j].name, nb*BSIZE + k*sizeof(*de));
+      nde[k++] = de[j];
+      memset(&de[j], 0, sizeof(de[j]));
+    }
+  }
+  log_write(np);
+  brelse(np);
+  log_write(lp);
+  brelse(lp);
+
+  memmove(&e[i+2], &e[i+1], (hd->n - i - 1) * sizeof(*e));
+  memset(&e[i+1], 0, sizeof(*e));
+  e[i+1].hash = s;
+  e[i+1].block = nb;
+  hd->n++;
+  log_write(bp);
+  brelse(bp);
+
+  dp->size += BSIZE;
+  iupdate(dp);
+
+  return dirfree(dp, h >= s ? nb : lb);
+}
+
 // Write a new directory entry (name, inum) into the directory dp.
+// Returns -1 if name is present or there is no room for it.
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
   int off;
   struct dirent de;
   struct inode *ip;
+  struct buf *bp;
 
   // Check that name is not present.
   if((ip = dirlookup(dp, name, 0)) != 0){
@@ -562,22 +1307,61 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
+  if((bp = dxread(dp)) != 0){
+    if((off = dxlink(dp, bp, name)) < 0)
+      return -1;
+  } else {
+    // Look for an empty dirent.
+    for(off = 0; off < dp->size; off += sizeof(de)){
+      if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlink read");
+      if(de.inum == 0)
+        break;
+    }
+    if(off == BSIZE && dp->size == BSIZE && dxinit(dp) == 0){
+      if((off = dxlink(dp, dxread(dp), name)) < 0)
+        return -1;
+    }
   }
 
+  memset(&de, 0, sizeof(de));
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcacheput(dp, name, inum, off);
 
   return 0;
 }
 
+// Remove the entry for name, found by dirlookup() at offset off,
+// from the directory dp.
+int
+dirunlink(struct inode *dp, char *name, uint off)
+{
+  struct dirent de;
+
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+    return -1;
+  dcacheput(dp, name, 0, 0);
+  return 0;
+}
+
+// Report inode and name cache statistics.
+void
+fsstat(struct iostat *st)
+{
+  acquire(&icache.lock);
+  st->ihits = icache.hits;
+  st->imisses = icache.misses;
+  release(&icache.lock);
+  acquire(&dcache.lock);
+  st->dhits = dcache.hits;
+  st->dmisses = dcache.misses;
+  release(&dcache.lock);
+}
+
 //PAGEBREAK!
 // Paths
 
@@ -622,6 +1406,8 @@ skipelem(char *path, char *name)
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
 // Must be called inside a transaction since it calls iput().
+// Directories are only read, so each one is locked in shared mode
+// and concurrent lookups through the same directory don't serialize.
 static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
@@ -633,21 +1419,22 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    ilock_shared(ip);
     if(ip->type != T_DIR){
-      iunlockput(ip);
+      iunlock_shared(ip);
+      iput(ip);
       return 0;
     }
     if(nameiparent && *path == '\0'){
       // Stop one level early.
-      iunlock(ip);
+      iunlock_shared(ip);
       return ip;
     }
-    if((next = dirlookup(ip, name, 0)) == 0){
-      iunlockput(ip);
+    next = dirlookup(ip, name, 0);
+    iunlock_shared(ip);
+    iput(ip);
+    if(next == 0)
       return 0;
-    }
-    iunlockput(ip);
     ip = next;
   }
   if(nameiparent){
@@ -3,7 +3,7 @@
 
 
 #define ROOTINO 1  // root i-number
-#define BSIZE 512  // block size
+#define BSIZE 4096  // block size
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
@@ -21,9 +21,10 @@ struct superblock {
   uint bmapstart;    // Block number of first free map block
 };
 
-#define NDIRECT 12
+#define NDIRECT 11
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -32,7 +33,7 @@ struct dinode {
   short minor;          // Minor device number (T_DEV only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+2];   // Data block addresses
 };
 
 // Inodes per block.
@@ -47,11 +48,39 @@ struct dinode {
 // Block of free map containing bit for block b
 #define BBLOCK(b, sb) (b/BPB + sb.bmapstart)
 
+// Bitmap blocks mkfs gives a file system of FSSIZE blocks
+#define NBITMAP       (FSSIZE/BPB + 1)
+
 // Directory is a file containing a sequence of dirent structures.
-#define DIRSIZ 14
+#define DIRSIZ 30
 
 struct dirent {
   ushort inum;
   char name[DIRSIZ];
 };
 
+// A directory larger than one block is indexed by a hash of the
+// names. Block 0 holds ".", "..", a dxhead and the index, and each
+// dxentry names the leaf block with the entries whose hash is at
+// least dxentry.hash and below the next dxentry's. The index
+// records have inum 0, so a program reading the directory as an
+// array of dirents skips them as free entries.
+#define DXMAGIC 0x78696478  // "xdix"
+#define DXMAX   (BSIZE/sizeof(struct dirent) - 3)  // leaves of a directory
+
+struct dxhead {
+  ushort inum;       // always 0
+  ushort pad;
+  uint magic;        // DXMAGIC
+  uint n;            // dxentry in use
+  char unused[sizeof(struct dirent) - 12];
+};
+
+struct dxentry {
+  ushort inum;       // always 0
+  ushort pad;
+  uint hash;         // smallest hash in the leaf; 0 for the first one
+  uint block;        // leaf block within the directory
+  char unused[sizeof(struct dirent) - 12];
+};
+
@@ -0,0 +1,141 @@
+// Futexes: futex_wait() sleeps while a user word holds a given
+// value, futex_wake() wakes sleepers on the word.
+//
+// A futex is named by the physical address of its word, so the
+// threads of a process and processes sharing the page through
+// mmap() or shmat() meet on the same one.  Sleepers are kept in a
+// hash table of lists, each with its own lock, and woken one by
+// one with wakeproc(), without scanning the process table.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
+#include "x86.h"
+
+#define NFUTEXHASH 32
+
+// A sleeper, on the stack of its process.
+struct waiter {
+  uint key;              // physical address of the word
+  struct proc *p;
+  int woken;
+  struct waiter *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct waiter *head;
+} futextab[NFUTEXHASH];
+
+// In vm.c.
+extern pte_t *walkpgdir(pde_t *pgdir, const void *va, int alloc);
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEXHASH; i++)
+    initlock(&futextab[i].lock, "futex");
+}
+
+// Physical address of the user word at addr, or 0.  The page is
+// written to first: users always write their futex words, and
+// breaking copy-on-write now keeps the name from changing while
+// someone sleeps on it.
+static uint
+futexkey(uint addr)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  uint key;
+
+  if(addr % 4 || uvmcheck(addr, 4, 1) < 0)
+    return 0;
+  xadd((uint*)addr, 0);
+  key = 0;
+  acquire(&p->mm->lock);
+  pte = walkpgdir(p->pgdir, (void*)addr, 0);
+  if(pte && (*pte & (PTE_P|PTE_W|PTE_U)) == (PTE_P|PTE_W|PTE_U))
+    key = PTE_ADDR(*pte) | (addr & (PGSIZE-1));
+  release(&p->mm->lock);
+  return key;
+}
+
+static uint
+hash(uint key)
+{
+  return (key >> 2) % NFUTEXHASH;
+}
+
+// Sleep until futexwake() on addr, if the word there holds val.
+// Returns 0 when woken, or -1 if the word held another value or
+// the process was killed.
+int
+futexwait(uint addr, int val)
+{
+  struct waiter w, **pp;
+  uint key, h;
+
+  if((key = futexkey(addr)) == 0)
+    return -1;
+  h = hash(key);
+  acquire(&futextab[h].lock);
+  // Through the kernel mapping: no fault with the lock held.
+  if(*(volatile int*)P2V(key) != val){
+    release(&futextab[h].lock);
+    return -1;
+  }
+  w.key = key;
+  w.p = myproc();
+  w.woken = 0;
+  w.next = 0;
+  for(pp = &futextab[h].head; *pp; pp = &(*pp)->next)
+    ;
+  *pp = &w;
+  while(!w.woken && !myproc()->killed)
+    sleep(&w, &futextab[h].lock);
+  if(!w.woken){
+    for(pp = &futextab[h].head; *pp != &w; pp = &(*pp)->next)
+      ;
+    *pp = w.next;
+  }
+  release(&futextab[h].lock);
+  return w.woken ? 0 : -1;
+}
+
+// Wake up to n sleepers on addr, oldest first.
+// Returns how many were woken, or -1.
+int
+futexwake(uint addr, int n)
+{
+  struct waiter *w, **pp;
+  uint key, h;
+  int woken;
+
+  if((key = futexkey(addr)) == 0)
+    return -1;
+  h = hash(key);
+  woken = 0;
+  acquire(&futextab[h].lock);
+  for(pp = &futextab[h].head; *pp && woken < n; ){
+    w = *pp;
+    if(w->key != key){
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    w->woken = 1;
+    // w stays valid: its process needs the lock we hold to return.
+    wakeproc(w->p, w);
+    woken++;
+  }
+  release(&futextab[h].lock);
+  return woken;
+}
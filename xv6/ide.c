@@ -1,4 +1,6 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// Simple IDE driver code.
+// Uses PCI bus-master DMA when the controller supports it,
+// programmed I/O otherwise.
 
 #include "types.h"
 #include "defs.h"
@@ -12,6 +14,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "iostat.h"
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
@@ -23,16 +26,61 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+#define IDE_CMD_RDDMA 0xc8
+#define IDE_CMD_WRDMA 0xca
 
-// idequeue points to the buf now being read/written to the disk.
-// idequeue->qnext points to the next buf to be processed.
+// PCI configuration space access (mechanism #1).
+#define PCI_CONFADDR  0xcf8
+#define PCI_CONFDATA  0xcfc
+#define PCI_CMD       0x04   // command register
+#define PCI_CLASS     0x08   // class, subclass, prog-if, revision
+#define PCI_BAR4      0x20   // bus master IDE base address
+#define PCI_CMD_IO    0x01
+#define PCI_CMD_BM    0x04
+
+// Bus master IDE registers of the primary channel, relative to BAR4.
+#define BM_CMD        0
+#define BM_STATUS     2
+#define BM_PRDT       4
+#define BM_CMD_START  0x01
+#define BM_CMD_READ   0x08   // device to memory
+#define BM_ST_ERR     0x02
+#define BM_ST_INTR    0x04
+
+// Physical region descriptor: one contiguous piece of a transfer.
+// The table must be 4-byte aligned and must not cross a 64KB boundary.
+struct prd {
+  uint addr;
+  ushort count;   // bytes, 0 means 64KB
+  ushort flags;
+};
+#define PRD_EOT       0x8000 // last entry of the table
+
+// Most sectors a single command can move (sector count 0 means 256).
+#define IDE_MAXSECT   256
+
+// idequeue holds the bufs waiting for the disk, linked by qnext and
+// sorted by (dev, blockno); idetail is its last buf, so requests that
+// arrive in ascending order (the common case) are added in O(1).
+// ideactive is the chain of adjacent bufs that the current command
+// is transferring.  headdev/headblock is where that command ends:
+// the next one starts there or above (C-LOOK).
 // You must hold idelock while manipulating queue.
 
 static struct spinlock idelock;
-static struct buf *idequeue;
+static struct buf *idequeue, *idetail, *ideactive;
+static uint headdev, headblock;
 
 static int havedisk1;
-static void idestart(struct buf*);
+static void idestart(struct buf*, int);
+
+// Bus master state, set up by idedmainit().
+static ushort bmbase;   // I/O base of the primary channel, 0 if no DMA
+static struct prd prdt[PGSIZE/sizeof(struct prd)] __attribute__((aligned(PGSIZE)));
+
+static uint ndiskread, ndiskwrite, ndiskcmd;
+static uint64 qcycles, scycles;   // time queued / being served, summed over bufs
 
 // Wait for IDE disk to become ready.
 static int
@@ -47,6 +95,63 @@ idewait(int checkerr)
   return 0;
 }
 
+static uint
+pciread(int bus, int dev, int func, int off)
+{
+  outl(PCI_CONFADDR, 0x80000000 | bus<<16 | dev<<11 | func<<8 | off);
+  return inl(PCI_CONFDATA);
+}
+
+static void
+pciwrite(int bus, int dev, int func, int off, uint v)
+{
+  outl(PCI_CONFADDR, 0x80000000 | bus<<16 | dev<<11 | func<<8 | off);
+  outl(PCI_CONFDATA, v);
+}
+
+// Look for an IDE controller with bus master support on PCI bus 0
+// (the PIIX in QEMU) and enable it.  Leaves bmbase at 0, and the
+// driver in PIO mode, if there is none.
+static void
+idedmainit(void)
+{
+  int dev, func;
+  uint class, bar;
+
+  for(dev = 0; dev < 32; dev++){
+    for(func = 0; func < 8; func++){
+      if((pciread(0, dev, func, 0) & 0xffff) == 0xffff)
+        continue;
+      class = pciread(0, dev, func, PCI_CLASS);
+      // Mass storage (0x01), IDE (0x01), bus master capable (prog-if bit 7).
+      if((class >> 16) != 0x0101 || !(class & (0x80 << 8)))
+        continue;
+      bar = pciread(0, dev, func, PCI_BAR4);
+      if(!(bar & 1) || (bar & ~3) == 0)
+        continue;
+      pciwrite(0, dev, func, PCI_CMD,
+               pciread(0, dev, func, PCI_CMD) | PCI_CMD_IO | PCI_CMD_BM);
+      bmbase = bar & 0xfffc;
+      outb(bmbase+BM_CMD, 0);
+      outb(bmbase+BM_STATUS, BM_ST_ERR|BM_ST_INTR);
+      return;
+    }
+  }
+}
+
+// Have drive d move a whole block per interrupt with
+// READ/WRITE MULTIPLE, as idestart() expects in PIO mode.
+static void
+idesetmul(int d)
+{
+  outb(0x3f6, 2);  // no interrupt; idestart() turns it back on
+  outb(0x1f6, 0xe0 | (d<<4));
+  outb(0x1f2, BSIZE/SECTOR_SIZE);
+  outb(0x1f7, IDE_CMD_SETMUL);
+  if(idewait(1) < 0)
+    panic("ide: set multiple mode");
+}
+
 void
 ideinit(void)
 {
@@ -65,33 +170,63 @@ ideinit(void)
     }
   }
 
+  if(BSIZE/SECTOR_SIZE > 1){
+    idesetmul(0);
+    if(havedisk1)
+      idesetmul(1);
+  }
+
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
+
+  idedmainit();
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Start the command for the chain of n adjacent bufs at b.
+// Caller must hold idelock.
 static void
-idestart(struct buf *b)
+idestart(struct buf *b, int n)
 {
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  if(b->blockno + n > FSSIZE)
     panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
   int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
   int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
+  int dir, i;
+  struct buf *p;
+
+  if (n > 1 && !bmbase) panic("idestart: merged pio");
 
-  if (sector_per_block > 7) panic("idestart");
+  ndiskcmd++;
+  if(b->flags & B_DIRTY)
+    ndiskwrite += n;
+  else
+    ndiskread += n;
 
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, (n*sector_per_block) & 0xff);  // number of sectors, 0 is 256
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
-  if(b->flags & B_DIRTY){
+  if(bmbase){
+    // One PRD per buf: each b->data lies inside a single kalloc page.
+    for(p = b, i = 0; p; p = p->qnext, i++){
+      prdt[i].addr = V2P(p->data);
+      prdt[i].count = BSIZE;
+      prdt[i].flags = p->qnext ? 0 : PRD_EOT;
+    }
+    dir = (b->flags & B_DIRTY) ? 0 : BM_CMD_READ;
+    outl(bmbase+BM_PRDT, V2P(prdt));
+    outb(bmbase+BM_CMD, dir);
+    outb(bmbase+BM_STATUS, BM_ST_ERR|BM_ST_INTR);
+    outb(0x1f7, (b->flags & B_DIRTY) ? IDE_CMD_WRDMA : IDE_CMD_RDDMA);
+    outb(bmbase+BM_CMD, dir | BM_CMD_START);
+  } else if(b->flags & B_DIRTY){
     outb(0x1f7, write_cmd);
     outsl(0x1f0, b->data, BSIZE/4);
   } else {
@@ -99,35 +234,152 @@ idestart(struct buf *b)
   }
 }
 
+// Is (dev1, blockno1) ahead of (dev2, blockno2) in the disk queue?
+static int
+idebefore(uint dev1, uint blockno1, uint dev2, uint blockno2)
+{
+  return dev1 < dev2 || (dev1 == dev2 && blockno1 < blockno2);
+}
+
+// If the disk is idle, pick the next request with C-LOOK: the first
+// queued buf at or above the end of the last command, or the lowest
+// one when there is none.  Adjacent bufs in the same direction join
+// it in a single command, up to IDE_MAXSECT sectors (PIO moves one
+// block per command).  Caller must hold idelock.
+static void
+idedispatch(void)
+{
+  struct buf *b, *prev, *last;
+  uint64 now;
+  int n, max;
+
+  if(ideactive != 0 || idequeue == 0)
+    return;
+
+  prev = 0;
+  for(b = idequeue; b; prev = b, b = b->qnext)
+    if(!idebefore(b->dev, b->blockno, headdev, headblock))
+      break;
+  if(b == 0){
+    prev = 0;
+    b = idequeue;
+  }
+
+  max = bmbase ? IDE_MAXSECT/(BSIZE/SECTOR_SIZE) : 1;
+  for(n = 1, last = b; n < max && last->qnext; n++, last = last->qnext){
+    if(last->qnext->dev != b->dev || last->qnext->blockno != last->blockno+1)
+      break;
+    if((last->qnext->flags & B_DIRTY) != (b->flags & B_DIRTY))
+      break;
+  }
+
+  // Move b..last from the queue to ideactive.
+  if(prev)
+    prev->qnext = last->qnext;
+  else
+    idequeue = last->qnext;
+  if(idetail == last)
+    idetail = prev;
+  last->qnext = 0;
+  ideactive = b;
+  headdev = last->dev;
+  headblock = last->blockno + 1;
+
+  now = rdtsc();
+  for(last = b; last; last = last->qnext){
+    qcycles += now - last->qtime;
+    last->qtime = now;
+  }
+  idestart(b, n);
+}
+
 // Interrupt handler.
 void
 ideintr(void)
 {
-  struct buf *b;
+  struct buf *b, *next, *done;
+  struct bbatch *bt;
+  uint64 now;
+  int st;
 
-  // First queued buffer is the active request.
+  // ideactive is the chain the finished command transferred.
   acquire(&idelock);
 
-  if((b = idequeue) == 0){
+  if((b = ideactive) == 0){
     release(&idelock);
     return;
   }
-  idequeue = b->qnext;
+  ideactive = 0;
 
-  // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
+  if(bmbase){
+    // Stop the bus master and acknowledge its interrupt; reading
+    // the status register acknowledges the drive.  Check both for
+    // errors first: the bufs must not be marked valid otherwise.
+    outb(bmbase+BM_CMD, 0);
+    st = inb(bmbase+BM_STATUS);
+    outb(bmbase+BM_STATUS, BM_ST_ERR|BM_ST_INTR);
+    if(idewait(1) < 0 || (st & BM_ST_ERR))
+      panic("ideintr: dma error");
+  } else if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
+    // Read data if needed.
     insl(0x1f0, b->data, BSIZE/4);
 
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
+  // Wake processes waiting for these bufs.
+  now = rdtsc();
+  done = 0;
+  for(; b; b = next){
+    next = b->qnext;
+    scycles += now - b->qtime;
+    b->flags |= B_VALID;
+    b->flags &= ~B_DIRTY;
+    if(b->flags & B_ASYNC){
+      // Submitted: release the buffer once idelock is dropped,
+      // and wake the batch when its last buf is done.
+      b->flags &= ~B_ASYNC;
+      if((bt = b->batch) != 0){
+        b->batch = 0;
+        if(--bt->pending == 0)
+          wakeup(bt);
+      }
+      b->qnext = done;
+      done = b;
+    } else
+      wakeup(b);
+  }
 
-  // Start disk on next buf in queue.
-  if(idequeue != 0)
-    idestart(idequeue);
+  // Start disk on next request.
+  idedispatch();
 
   release(&idelock);
+
+  for(; done; done = next){
+    next = done->qnext;
+    brelse_async(done);
+  }
+}
+
+// Add b to idequeue and start the disk if it was idle.
+// Caller must hold idelock.
+static void
+ideappend(struct buf *b)
+{
+  struct buf **pp;
+
+  b->qnext = 0;
+  b->qtime = rdtsc();
+  if(idetail == 0)
+    idequeue = idetail = b;
+  else if(!idebefore(b->dev, b->blockno, idetail->dev, idetail->blockno)){
+    idetail->qnext = b;
+    idetail = b;
+  } else {
+    for(pp=&idequeue; !idebefore(b->dev, b->blockno, (*pp)->dev, (*pp)->blockno); pp=&(*pp)->qnext)  //DOC:insert-queue
+      ;
+    b->qnext = *pp;
+    *pp = b;
+  }
+
+  idedispatch();
 }
 
 //PAGEBREAK!
@@ -137,8 +389,6 @@ ideintr(void)
 void
 iderw(struct buf *b)
 {
-  struct buf **pp;
-
   if(!holdingsleep(&b->lock))
     panic("iderw: buf not locked");
   if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
@@ -148,15 +398,7 @@ iderw(struct buf *b)
 
   acquire(&idelock);  //DOC:acquire-lock
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-    ;
-  *pp = b;
-
-  // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
+  ideappend(b);
 
   // Wait for request to finish.
   while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
@@ -166,3 +408,49 @@ iderw(struct buf *b)
 
   release(&idelock);
 }
+
+// Start the transfer of b like iderw() but return at once.
+// b must be locked; ideintr() hands it to brelse_async() when
+// done.  If bt is not 0, b counts as pending in bt until then;
+// see iderw_wait().
+void
+iderw_submit(struct buf *b, struct bbatch *bt)
+{
+  if(!holdingsleep(&b->lock))
+    panic("iderw_submit: buf not locked");
+  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
+    panic("iderw_submit: nothing to do");
+  if(b->dev != 0 && !havedisk1)
+    panic("iderw_submit: ide disk 1 not present");
+
+  acquire(&idelock);
+  if(bt){
+    bt->pending++;
+    b->batch = bt;
+  }
+  b->flags |= B_ASYNC;
+  ideappend(b);
+  release(&idelock);
+}
+
+// Wait until every buf submitted with bt is done.
+void
+iderw_wait(struct bbatch *bt)
+{
+  acquire(&idelock);
+  while(bt->pending > 0)
+    sleep(bt, &idelock);
+  release(&idelock);
+}
+
+// Report disk transfer counters for the iostat() system call.
+void
+idestat(struct iostat *st)
+{
+  st->dma = bmbase != 0;
+  st->ndiskread = ndiskread;
+  st->ndiskwrite = ndiskwrite;
+  st->ndiskcmd = ndiskcmd;
+  st->qwait = qcycles >> 10;
+  st->service = scycles >> 10;
+}
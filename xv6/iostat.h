@@ -0,0 +1,24 @@
+// Block I/O statistics, filled in by the iostat() system call.
+// Both the kernel and user programs use this header file.
+struct iostat {
+  uint nbuf;         // Buffers currently in the buffer cache
+  uint bhits;        // bget() found the block cached
+  uint bmisses;      // bget() had to recycle or allocate a buffer
+  uint bevictions;   // Cached blocks dropped to make room
+  uint nreadahead;   // Asynchronous read-ahead requests issued
+  uint dma;          // 1 if the disk driver uses bus-master DMA
+  uint ndiskread;    // Blocks read from the disk
+  uint ndiskwrite;   // Blocks written to the disk
+  uint ndiskcmd;     // Disk commands issued (adjacent blocks are merged)
+  uint qwait;        // Kcycles blocks spent queued for the disk, in total
+  uint service;      // Kcycles blocks spent being transferred, in total
+  uint nlog;         // Log capacity in blocks
+  uint ncommit;      // Log transactions committed
+  uint nlogged;      // Blocks written to the log
+  uint ihits;        // iget() found the inode in the inode cache
+  uint imisses;      // iget() had to recycle an inode cache entry
+  uint dhits;        // dirlookup() answered from the name cache
+  uint dmisses;      // dirlookup() had to scan the directory
+  uint nswitch;      // Context switches to processes
+  uint nsyscall;     // System calls by the caller and the children it waited for
+};
@@ -5,6 +5,9 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "mmu.h"
+#include "proc.h"
+#include "iostat.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -18,7 +21,13 @@
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the log thread has made room.
+//
+// Commits are done by a kernel thread, logthread(), not by
+// end_op(): it keeps a transaction open for LOGDELAY ticks so
+// that the system calls arriving meanwhile share one commit
+// (group commit).  A system call's updates are therefore on
+// disk shortly after it returns, not when it returns.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -27,58 +36,109 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// The data blocks form a ring of log.cap entries: the header's
+// tail is where entry 0 lives.  Committed blocks are installed at
+// their home locations lazily (checkpoint()), while later
+// transactions are already being appended after them.
 
-// Contents of the header block, used for both the on-disk header block
-// and to keep track in memory of logged block# before commit.
+// Contents of the header block.
 struct logheader {
   int n;
-  int block[LOGSIZE];
+  int tail;   // ring position of block[0]
+  int block[];
 };
 
+// Most entries one header block can describe.
+#define LOGMAXENT ((BSIZE - sizeof(struct logheader)) / sizeof(int))
+
 struct log {
   struct spinlock lock;
   int start;
   int size;
+  int cap;         // ring entries: log size from the superblock
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // log blocks declared by outstanding begin_opn()s
+  int committing;  // commit() is taking a snapshot, please wait.
+  int used;        // ring entries holding committed blocks
+  int waiting;     // begin_op() is waiting for log space
   int dev;
-  struct logheader lh;
+  struct {         // the header: committed, not yet installed blocks;
+    int n;         // only touched by the log thread after boot
+    int tail;
+    int *block;    // log.cap entries
+  } lh;
+  int nrun;        // blocks of the running transaction
+  int *run;        // log.cap entries
+  uint ncommit;    // statistics for iostat()
+  uint nlogged;
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static void logthread(void);
 
 void
 initlog(int dev)
 {
-  if (sizeof(struct logheader) >= BSIZE)
-    panic("initlog: too big logheader");
-
   struct superblock sb;
   initlock(&log.lock, "log");
   readsb(dev, &sb);
   log.start = sb.logstart;
   log.size = sb.nlog;
+  log.cap = log.size - 1;
+  if (log.cap > LOGMAXENT)
+    log.cap = LOGMAXENT;
+  if (log.cap > PGSIZE / sizeof(int))
+    log.cap = PGSIZE / sizeof(int);
+  if (log.cap < MAXOPBLOCKS)
+    panic("initlog: log too small");
+  if ((log.lh.block = (int*)kalloc()) == 0 || (log.run = (int*)kalloc()) == 0)
+    panic("initlog: out of memory");
   log.dev = dev;
   recover_from_log();
+  if(kthread("logthread", logthread) < 0)
+    panic("initlog: no log thread");
 }
 
-// Copy committed blocks from log to their home location
+// Disk block holding ring entry pos.
+static int
+logblock(int pos)
+{
+  return log.start + 1 + pos % log.cap;
+}
+
+// Does committed entry k get overwritten by a later one?
+static int
+superseded(int k)
+{
+  int j;
+
+  for (j = k + 1; j < log.lh.n; j++)
+    if (log.lh.block[j] == log.lh.block[k])
+      return 1;
+  return 0;
+}
+
+// Copy committed blocks from log to their home location.
+// Only used by recovery; all the home writes are in flight at once.
 static void
 install_trans(void)
 {
   int tail;
+  struct bbatch bt;
 
+  bt.pending = 0;
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
+    if (superseded(tail))
+      continue;
+    struct buf *lbuf = bread(log.dev, logblock(log.lh.tail+tail)); // read log block
     struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
     brelse(lbuf);
-    brelse(dbuf);
+    dbuf->flags |= B_DIRTY;
+    bsubmit(dbuf, &bt);  // write dst to disk
   }
+  bwait(&bt);
 }
 
 // Read the log header from disk into the in-memory log header
@@ -89,6 +149,7 @@ read_head(void)
   struct logheader *lh = (struct logheader *) (buf->data);
   int i;
   log.lh.n = lh->n;
+  log.lh.tail = lh->tail;
   for (i = 0; i < log.lh.n; i++) {
     log.lh.block[i] = lh->block[i];
   }
@@ -105,6 +166,7 @@ write_head(void)
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
   hb->n = log.lh.n;
+  hb->tail = log.lh.tail;
   for (i = 0; i < log.lh.n; i++) {
     hb->block[i] = log.lh.block[i];
   }
@@ -118,6 +180,7 @@ recover_from_log(void)
   read_head();
   install_trans(); // if committed, copy from log to disk
   log.lh.n = 0;
+  log.lh.tail = 0;
   write_head(); // clear the log
 }
 
@@ -125,15 +188,31 @@ recover_from_log(void)
 void
 begin_op(void)
 {
+  begin_opn(MAXOPBLOCKS);
+}
+
+// Like begin_op() for an operation that declares it writes
+// at most nblocks blocks, which must not exceed log_opmax().
+void
+begin_opn(int nblocks)
+{
+  if(nblocks > log_opmax())
+    panic("begin_opn: too many blocks");
+
   acquire(&log.lock);
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    } else if(log.used + log.nrun + log.reserved + nblocks > log.cap){
+      // this op might exhaust log space; have the log thread
+      // commit and checkpoint.
+      log.waiting = 1;
+      wakeup(&log.nrun);
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += nblocks;
+      myproc()->logresv = nblocks;
       release(&log.lock);
       break;
     }
@@ -141,69 +220,168 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// The log thread commits once the transaction has been open
+// for LOGDELAY ticks and no operation is outstanding.
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
-  } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
-  }
+  log.reserved -= myproc()->logresv;
+  if(log.outstanding == 0)
+    wakeup(&log.nrun);
+  // begin_op() may be waiting for log space,
+  // and decrementing log.outstanding has decreased
+  // the amount of reserved space.
+  wakeup(&log);
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
-  }
+// Most blocks a single operation may declare; half the log,
+// so that a large operation can be admitted while the previous
+// transaction still occupies the rest.
+int
+log_opmax(void)
+{
+  return log.cap / 2;
 }
 
-// Copy modified blocks from cache to log.
+// Close the running transaction and make it durable.
+// New operations may start as soon as its blocks have been
+// copied to the log buffers, before they reach the disk.
 static void
-write_log(void)
+commit(void)
 {
-  int tail;
+  int n, k, pos;
+  struct bbatch bt;
+  struct buf *to, *from;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
+  acquire(&log.lock);
+  log.committing = 1;
+  while(log.outstanding > 0)
+    sleep(&log.nrun, &log.lock);
+  n = log.nrun;
+  for (k = 0; k < n; k++)
+    log.lh.block[log.lh.n+k] = log.run[k];  // published by lh.n below
+  release(&log.lock);
+
+  // Copy modified blocks from cache to log.
+  bt.pending = 0;
+  pos = log.lh.tail + log.lh.n;
+  for (k = 0; k < n; k++) {
+    to = bread(log.dev, logblock(pos+k)); // log block
+    from = bread(log.dev, log.lh.block[log.lh.n+k]); // cache block
     memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
     brelse(from);
-    brelse(to);
+    to->flags |= B_DIRTY;
+    bsubmit(to, &bt);  // write the log
   }
+
+  acquire(&log.lock);
+  log.used += n;
+  log.nrun = 0;
+  log.committing = 0;
+  wakeup(&log);
+  release(&log.lock);
+
+  if (n > 0) {
+    bwait(&bt);
+    log.lh.n += n;
+    log.ncommit++;
+    log.nlogged += n;
+    write_head();    // Write header to disk -- the real commit
+  }
+}
+
+// Is blockno part of the running transaction?
+static int
+inrun(uint blockno)
+{
+  int i, r;
+
+  r = 0;
+  acquire(&log.lock);
+  for (i = 0; i < log.nrun; i++)
+    if (log.run[i] == blockno)
+      r = 1;
+  release(&log.lock);
+  return r;
 }
 
+// Install committed blocks at their home locations, oldest
+// first, and free their ring entries.  The home copy in the
+// cache is written unless a later committed entry will write it
+// anyway.  A block that the running transaction has modified
+// again cannot be written before that transaction commits, so
+// the checkpoint stops there.
 static void
-commit()
+checkpoint(void)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  int k, i;
+  struct bbatch bt;
+  struct buf *b;
+
+  bt.pending = 0;
+  for (k = 0; k < log.lh.n; k++) {
+    if (superseded(k))
+      continue;
+    // log_write() happens before brelse(), so while we hold b
+    // the running transaction cannot pick it up unnoticed.
+    b = bread(log.dev, log.lh.block[k]);
+    if (inrun(b->blockno)) {
+      brelse(b);
+      break;
+    }
+    b->flags |= B_DIRTY;
+    bsubmit(b, &bt);  // write home location
+  }
+  bwait(&bt);
+  if (k > 0) {
+    for (i = k; i < log.lh.n; i++)
+      log.lh.block[i-k] = log.lh.block[i];
+    log.lh.n -= k;
+    log.lh.tail = (log.lh.tail + k) % log.cap;
+    write_head();    // Erase the installed blocks from the log
+  }
+
+  acquire(&log.lock);
+  log.used -= k;
+  log.waiting = 0;
+  wakeup(&log);
+  release(&log.lock);
+}
+
+// The log thread: commits the running transaction LOGDELAY ticks
+// after it was opened, and checkpoints when the log is more than
+// half full or begin_op() is waiting for space.
+static void
+logthread(void)
+{
+  uint t0;
+
+  for(;;){
+    acquire(&log.lock);
+    while(log.nrun == 0 && !log.waiting)
+      sleep(&log.nrun, &log.lock);
+    release(&log.lock);
+
+    if(!log.waiting){
+      acquire(&tickslock);
+      t0 = ticks;
+      while(ticks - t0 < LOGDELAY)
+        sleep(&ticks, &tickslock);
+      release(&tickslock);
+    }
+
+    commit();
+    if(log.waiting || log.used > log.cap/2)
+      checkpoint();
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache with B_DIRTY.
-// commit()/write_log() will do the disk write.
+// commit() will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -215,20 +393,29 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.nrun >= log.cap)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
   acquire(&log.lock);
-  for (i = 0; i < log.lh.n; i++) {
-    if (log.lh.block[i] == b->blockno)   // log absorbtion
+  for (i = 0; i < log.nrun; i++) {
+    if (log.run[i] == b->blockno)   // log absorbtion
       break;
   }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n)
-    log.lh.n++;
+  log.run[i] = b->blockno;
+  if (i == log.nrun)
+    log.nrun++;
   b->flags |= B_DIRTY; // prevent eviction
   release(&log.lock);
 }
 
+
+// Report log counters for the iostat() system call.
+void
+logstat(struct iostat *st)
+{
+  st->nlog = log.cap;
+  st->ncommit = log.ncommit;
+  st->nlogged = log.nlogged;
+}
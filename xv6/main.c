@@ -30,6 +30,9 @@ main(void)
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
+  shminit();       // shared memory segments
+  futexinit();     // futex wait queues
+  pollinit();      // poll() wait queues
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
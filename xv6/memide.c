@@ -12,17 +12,19 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "iostat.h"
 
-extern uchar _binary_fs_img_start[], _binary_fs_img_size[];
+extern uchar _binary_fsmemfs_img_start[], _binary_fsmemfs_img_size[];
 
 static int disksize;
 static uchar *memdisk;
+static uint ndiskread, ndiskwrite;
 
 void
 ideinit(void)
 {
-  memdisk = _binary_fs_img_start;
-  disksize = (uint)_binary_fs_img_size/BSIZE;
+  memdisk = _binary_fsmemfs_img_start;
+  disksize = (uint)_binary_fsmemfs_img_size/BSIZE;
 }
 
 // Interrupt handler.
@@ -54,7 +56,33 @@ iderw(struct buf *b)
   if(b->flags & B_DIRTY){
     b->flags &= ~B_DIRTY;
     memmove(p, b->data, BSIZE);
-  } else
+    ndiskwrite++;
+  } else {
     memmove(b->data, p, BSIZE);
+    ndiskread++;
+  }
   b->flags |= B_VALID;
 }
+
+// Memory copies are synchronous: transfer now and release.
+void
+iderw_submit(struct buf *b, struct bbatch *bt)
+{
+  iderw(b);
+  brelse_async(b);
+}
+
+void
+iderw_wait(struct bbatch *bt)
+{
+}
+
+void
+idestat(struct iostat *st)
+{
+  st->dma = 0;
+  st->ndiskread = ndiskread;
+  st->ndiskwrite = ndiskwrite;
+  st->ndiskcmd = ndiskread + ndiskwrite;
+  st->qwait = st->service = 0;
+}
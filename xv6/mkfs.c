@@ -18,10 +18,15 @@
 
 #define NINODES 200
 
+// Size of the image in blocks; kernelmemfs builds a smaller one.
+#ifndef MKFSSIZE
+#define MKFSSIZE FSSIZE
+#endif
+
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
 
-int nbitmap = FSSIZE/(BSIZE*8) + 1;
+int nbitmap = NBITMAP;
 int ninodeblocks = NINODES / IPB + 1;
 int nlog = LOGSIZE;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
@@ -41,6 +46,7 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void dirwrite(uint inum, struct dirent *de, int n);
 
 // convert to intel byte order
 ushort
@@ -70,7 +76,8 @@ main(int argc, char *argv[])
 {
   int i, cc, fd;
   uint rootino, inum, off;
-  struct dirent de;
+  struct dirent de, *rootde;
+  int nroot;
   char buf[BSIZE];
   struct dinode din;
 
@@ -92,9 +99,9 @@ main(int argc, char *argv[])
 
   // 1 fs block = 1 disk sector
   nmeta = 2 + nlog + ninodeblocks + nbitmap;
-  nblocks = FSSIZE - nmeta;
+  nblocks = MKFSSIZE - nmeta;
 
-  sb.size = xint(FSSIZE);
+  sb.size = xint(MKFSSIZE);
   sb.nblocks = xint(nblocks);
   sb.ninodes = xint(NINODES);
   sb.nlog = xint(nlog);
@@ -103,11 +110,11 @@ main(int argc, char *argv[])
   sb.bmapstart = xint(2+nlog+ninodeblocks);
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+         nmeta, nlog, ninodeblocks, nbitmap, nblocks, MKFSSIZE);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
-  for(i = 0; i < FSSIZE; i++)
+  for(i = 0; i < MKFSSIZE; i++)
     wsect(i, zeroes);
 
   memset(buf, 0, sizeof(buf));
@@ -117,15 +124,20 @@ main(int argc, char *argv[])
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
 
+  // Root directory entries, written by dirwrite() at the end.
+  rootde = calloc(argc, sizeof(de));
+  assert(rootde != 0);
+  nroot = 0;
+
   bzero(&de, sizeof(de));
   de.inum = xshort(rootino);
   strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
+  rootde[nroot++] = de;
 
   bzero(&de, sizeof(de));
   de.inum = xshort(rootino);
   strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  rootde[nroot++] = de;
 
   for(i = 2; i < argc; i++)
   {
@@ -144,7 +156,7 @@ main(int argc, char *argv[])
     char * nameonly = strdup (argv[i]);
 
     strncpy(de.name, basename (nameonly), DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    rootde[nroot++] = de;
 
     free (nameonly);
 
@@ -154,10 +166,13 @@ main(int argc, char *argv[])
     close(fd);
   }
 
+  dirwrite(rootino, rootde, nroot);
+  free(rootde);
+
   // fix size of root inode dir
   rinode(rootino, &din);
   off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
+  off = ((off + BSIZE - 1) / BSIZE) * BSIZE;
   din.size = xint(off);
   winode(rootino, &din);
 
@@ -251,6 +266,24 @@ balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return entry i of the indirect block whose address is at *ind,
+// allocating the block and the entry as needed.  Both *ind and
+// the result are in disk byte order.
+uint
+iindex(uint *ind, uint i)
+{
+  uint indirect[NINDIRECT];
+
+  if(xint(*ind) == 0)
+    *ind = xint(freeblock++);
+  rsect(xint(*ind), (char*)indirect);
+  if(indirect[i] == 0){
+    indirect[i] = xint(freeblock++);
+    wsect(xint(*ind), (char*)indirect);
+  }
+  return indirect[i];
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -258,7 +291,6 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
@@ -272,16 +304,13 @@ iappend(uint inum, void *xp, int n)
         din.addrs[fbn] = xint(freeblock++);
       }
       x = xint(din.addrs[fbn]);
+    } else if(fbn < NDIRECT + NINDIRECT){
+      x = xint(iindex(&din.addrs[NDIRECT], fbn - NDIRECT));
     } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
+      fbn -= NDIRECT + NINDIRECT;
+      x = iindex(&din.addrs[NDIRECT+1], fbn / NINDIRECT);
+      x = xint(iindex(&x, fbn % NINDIRECT));
+      fbn = off / BSIZE;
     }
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
@@ -294,3 +323,73 @@ iappend(uint inum, void *xp, int n)
   din.size = xint(off);
   winode(inum, &din);
 }
+
+#define DPB (BSIZE / sizeof(struct dirent))
+
+// Must match dxhash() in fs.c.
+uint
+dxhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261U;
+  for(i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+int
+dxcmp(const void *a, const void *b)
+{
+  uint ha = dxhash(((struct dirent*)a)->name);
+  uint hb = dxhash(((struct dirent*)b)->name);
+
+  return ha < hb ? -1 : ha > hb;
+}
+
+// Write the n entries de of directory inum, "." and ".." first:
+// as a plain array if they fit in a block, else as an indexed
+// directory (see fs.h) whose leaves are three quarters full, so
+// that the kernel can add names without splitting them at once.
+void
+dirwrite(uint inum, struct dirent *de, int n)
+{
+  char buf[BSIZE];
+  struct dirent *blk = (struct dirent*)buf;
+  struct dxhead *hd = (struct dxhead*)(blk + 2);
+  struct dxentry *e = (struct dxentry*)(blk + 3);
+  int i, per, nleaf;
+
+  if(n <= DPB){
+    iappend(inum, de, n * sizeof(*de));
+    return;
+  }
+
+  qsort(de + 2, n - 2, sizeof(*de), dxcmp);
+  per = DPB * 3 / 4;
+  nleaf = (n - 2 + per - 1) / per;
+  assert(nleaf <= DXMAX);
+
+  bzero(buf, BSIZE);
+  blk[0] = de[0];
+  blk[1] = de[1];
+  hd->magic = xint(DXMAGIC);
+  hd->n = xint(nleaf);
+  for(i = 0; i < nleaf; i++){
+    // A hash must not span two leaves.
+    if(i > 0)
+      assert(dxhash(de[1 + i*per].name) != dxhash(de[2 + i*per].name));
+    e[i].hash = xint(i == 0 ? 0 : dxhash(de[2 + i*per].name));
+    e[i].block = xint(1 + i);
+  }
+  iappend(inum, buf, BSIZE);
+
+  for(i = 0; i < nleaf; i++){
+    bzero(buf, BSIZE);
+    memmove(buf, de + 2 + i*per, min(per, n - 2 - i*per) * sizeof(*de));
+    iappend(inum, buf, BSIZE);
+  }
+}
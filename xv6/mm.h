@@ -0,0 +1,21 @@
+// User address space of a process, shared by the threads that
+// clone() creates (see proc.c).  Each thread has its own struct
+// proc, with the same pgdir; the pgdir page has one reference
+// (see kalloc.c) per thread not yet reaped, so the last wait() or
+// join() frees the page tables.
+//
+// lock protects sz and changes to the page table; vmalock, which
+// may be held while sleeping, protects vma.  sz changes with both
+// held, so holding either one keeps it stable.  Pages unmapped by
+// sbrk(), munmap() or shmdt() are freed only after the TLBs of the
+// other CPUs running threads of the process have been flushed (see
+// tlbshootdown() in vm.c); entries that gain a permission are not
+// shot down, and a thread that faults on one just reloads cr3 (see
+// trap.c).
+struct mm {
+  struct spinlock lock;
+  struct sleeplock vmalock;
+  int ref;                 // live threads using it, under ptable.lock
+  uint sz;                 // Size of process memory (bytes)
+  struct vma vma[NVMA];    // mmap() mappings, above the heap
+};
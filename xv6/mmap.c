@@ -0,0 +1,574 @@
+// Memory mappings made with mmap().
+//
+// Each process has up to NVMA mappings, placed top-down from
+// MMAPTOP, above the heap.  Their pages are filled in lazily by
+// vmafault() on the first access:
+// * Anonymous mappings get zeroed pages.
+// * Private file mappings get a copy of the file page, read
+//   through the buffer cache.
+// * Shared file mappings map the buffer cache page itself, pinned
+//   in the cache while mapped, so they see and are seen by read()
+//   and write() at once.  The hardware dirty bit tells msync()
+//   and munmap() which of them to log as modified.
+// * Shared memory segments attached with shmat() map the pages of
+//   the segment (see shm.c).
+// * Shared anonymous mappings are backed by a segment of their own
+//   (shmanon()), so that after fork() parent and child find the
+//   same page even if neither had touched it before.
+//
+// The kernel may read from or write to mapped pages in system
+// calls: uvmcheck() faults the pages of a user buffer in before
+// the call goes on, so no fault has to read a file while the
+// kernel holds a spinlock.
+//
+// The threads of a process share the mappings (see mm.h): the
+// functions here hold vmalock while they use them, and take the
+// spinlock only to change the page table.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "mmu.h"
+#include "memlayout.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "x86.h"
+
+#if BSIZE != PGSIZE
+#error "shared mappings map buffer cache blocks as pages"
+#endif
+
+// In vm.c.
+extern int mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm);
+extern pte_t *walkpgdir(pde_t *pgdir, const void *va, int alloc);
+
+#define MMAPTOP KERNBASE
+#define MAXPINNED (NBUF/2)  // buffers shared mappings may pin
+
+static volatile uint npinned;
+
+// The mapping of p holding va, or 0.
+static struct vma*
+vmafind(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+    if(v->start && va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// A free mapping slot of p, or 0.
+static struct vma*
+vmaslot(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+    if(v->start == 0)
+      return v;
+  return 0;
+}
+
+// Lowest address used by the mappings of p: the heap may grow
+// up to it.  Called with p->mm->vmalock held.
+uint
+vmabase(struct proc *p)
+{
+  struct vma *v;
+  uint base;
+
+  base = MMAPTOP;
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+    if(v->start && v->start < base)
+      base = v->start;
+  return base;
+}
+
+// Highest free range of len bytes below MMAPTOP and above the
+// heap, or 0.
+static uint
+vmaplace(struct proc *p, uint len)
+{
+  struct vma *v, *w;
+  uint end, best;
+
+  best = 0;
+  for(w = p->mm->vma; w <= &p->mm->vma[NVMA]; w++){
+    // Try right below MMAPTOP and right below each mapping.
+    if(w == &p->mm->vma[NVMA])
+      end = MMAPTOP;
+    else if(w->start)
+      end = w->start;
+    else
+      continue;
+    if(end < len || end - len < PGROUNDUP(p->mm->sz) || end - len <= best)
+      continue;
+    for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+      if(v->start && v->start < end && v->end > end - len)
+        break;
+    if(v == &p->mm->vma[NVMA])
+      best = end - len;
+  }
+  return best;
+}
+
+// Fault in the page of the mapping of p at va.
+// Called with p->mm->vmalock held.
+static int
+fault(struct proc *p, uint va, int write)
+{
+  struct vma *v;
+  struct inode *ip;
+  pte_t *pte;
+  char *mem;
+  uint a, off;
+  int n, perm;
+
+  if((v = vmafind(p, va)) == 0 || (write && !(v->prot & PROT_WRITE)) ||
+     !(v->prot & (PROT_READ|PROT_WRITE)))
+    return -1;
+  a = PGROUNDDOWN(va);
+  pte = walkpgdir(p->pgdir, (void*)a, 0);
+  if(pte && (*pte & PTE_P))
+    return 0;
+
+  off = v->off + (a - v->start);
+  if(v->shm){
+    if((mem = shmpage(v->shm, off)) == 0)
+      return -1;
+  } else if(v->f && (v->flags & MAP_SHARED)){
+    if(npinned >= MAXPINNED)
+      return -1;
+    ip = v->f->ip;
+    ilock_shared(ip);
+    mem = ipin(ip, off);
+    iunlock_shared(ip);
+    if(mem == 0)
+      return -1;
+    xadd(&npinned, 1);
+    kref(mem);
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    if(v->f){
+      ip = v->f->ip;
+      ilock_shared(ip);
+      n = off < ip->size ? readi(ip, mem, off, PGSIZE) : -1;
+      iunlock_shared(ip);
+      if(n < 0){
+        kfree(mem);
+        return -1;
+      }
+    }
+  }
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  acquire(&p->mm->lock);
+  n = mappages(p->pgdir, (void*)a, PGSIZE, V2P(mem), perm);
+  release(&p->mm->lock);
+  if(n < 0){
+    kfree(mem);
+    if(v->f && (v->flags & MAP_SHARED)){
+      ilock_shared(v->f->ip);
+      iunpin(v->f->ip, off);
+      iunlock_shared(v->f->ip);
+      xadd(&npinned, -1);
+    }
+    return -1;
+  }
+  return 0;
+}
+
+// Fault in the page of the mapping at va. Returns -1 if va is
+// not mapped, the access is not allowed or there is no memory.
+int
+vmafault(uint va, int write)
+{
+  struct proc *p = myproc();
+  int r;
+
+  acquiresleep(&p->mm->vmalock);
+  r = fault(p, va, write);
+  releasesleep(&p->mm->vmalock);
+  return r;
+}
+
+// Check that the kernel may read (write == 0) or write the user
+// buffer [addr, addr+len) of the current process: it must lie
+// below p->sz or in one mapping that allows the access. The
+// pages of a mapping are faulted in. Returns 0 if so.
+int
+uvmcheck(uint addr, uint len, int write)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint a;
+  int r;
+
+  if(addr + len < addr)
+    return -1;
+  if(addr < p->mm->sz && addr + len <= p->mm->sz)
+    return 0;
+  acquiresleep(&p->mm->vmalock);
+  r = -1;
+  if((v = vmafind(p, addr)) != 0 && addr + len <= v->end){
+    for(a = PGROUNDDOWN(addr); a < addr + len; a += PGSIZE)
+      if(fault(p, a, write) < 0)
+        break;
+    if(a >= addr + len)
+      r = 0;
+  }
+  releasesleep(&p->mm->vmalock);
+  return r;
+}
+
+// Log the dirty pages of the shared file mapping v in [start, end)
+// as modified blocks of the file, in transactions of at most
+// MAXOPBLOCKS blocks.
+static void
+vmasync(struct proc *p, struct vma *v, uint start, uint end)
+{
+  struct inode *ip;
+  pte_t *pte;
+  uint a, dirty[MAXOPBLOCKS];
+  int i, n;
+
+  if(v->f == 0 || !(v->flags & MAP_SHARED) || !(v->prot & PROT_WRITE))
+    return;
+  ip = v->f->ip;
+  for(a = start; a < end; ){
+    n = 0;
+    for(; a < end && n < MAXOPBLOCKS; a += PGSIZE){
+      pte = walkpgdir(p->pgdir, (void*)a, 0);
+      if(pte && (*pte & PTE_P) && (*pte & PTE_D)){
+        *pte &= ~PTE_D;
+        dirty[n++] = v->off + (a - v->start);
+      }
+    }
+    if(n == 0)
+      continue;
+    // Writes from now on, by any thread, set the dirty bits again.
+    tlbshootdown(p->mm);
+    begin_op();
+    ilock_shared(ip);
+    for(i = 0; i < n; i++)
+      isync(ip, dirty[i]);
+    iunlock_shared(ip);
+    end_op();
+  }
+}
+
+// Remove the pages of v in [start, end) from p's page table,
+// writing dirty shared file pages back first.  The pages are
+// dropped in batches, each once no CPU running a thread of p can
+// still reach them (see tlbshootdown()).
+static void
+vmaunmap(struct proc *p, struct vma *v, uint start, uint end)
+{
+  pte_t *pte;
+  uint a, va[32];
+  char *page[32];
+  int i, n, shared;
+
+  vmasync(p, v, start, end);
+  shared = v->f && (v->flags & MAP_SHARED);
+  if(shared)
+    ilock_shared(v->f->ip);
+  for(a = start; a < end; ){
+    n = 0;
+    acquire(&p->mm->lock);
+    for(; a < end && n < NELEM(page); a += PGSIZE){
+      pte = walkpgdir(p->pgdir, (void*)a, 0);
+      if(pte && (*pte & PTE_P)){
+        page[n] = P2V(PTE_ADDR(*pte));
+        va[n++] = a;
+        *pte = 0;
+      }
+    }
+    release(&p->mm->lock);
+    if(n == 0)
+      continue;
+    tlbshootdown(p->mm);
+    for(i = 0; i < n; i++){
+      kfree(page[i]);
+      if(shared){
+        iunpin(v->f->ip, v->off + (va[i] - v->start));
+        xadd(&npinned, -1);
+      }
+    }
+  }
+  if(shared)
+    iunlock_shared(v->f->ip);
+}
+
+// Map len bytes of f from offset off, or anonymous memory if f is
+// 0, into the current process. Returns the address or -1.
+int
+mmap(uint len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+
+  if(len == 0 || (prot & ~(PROT_READ|PROT_WRITE)) ||
+     (flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+     (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE))
+    return -1;
+  if(f){
+    if(off % PGSIZE || f->type != FD_INODE || f->ip->type != T_FILE || !f->readable)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+  } else
+    off = 0;
+  if(len > MMAPTOP)
+    return -1;
+  len = PGROUNDUP(len);
+  acquiresleep(&p->mm->vmalock);
+  if((v = vmaslot(p)) == 0 || (v->start = vmaplace(p, len)) == 0){
+    releasesleep(&p->mm->vmalock);
+    return -1;
+  }
+  v->end = v->start + len;
+  v->prot = prot;
+  v->flags = flags;
+  v->shm = 0;
+  if(f == 0 && (flags & MAP_SHARED) && (v->shm = shmanon(len)) == 0){
+    v->start = 0;
+    releasesleep(&p->mm->vmalock);
+    return -1;
+  }
+  v->f = f ? filedup(f) : 0;
+  v->off = off;
+  releasesleep(&p->mm->vmalock);
+  return v->start;
+}
+
+// Unmap the pages in [addr, addr+len) of p. Parts of mappings
+// may be unmapped; unmapping the middle of one splits it in two.
+// Called with p->mm->vmalock held.
+static int
+unmap(struct proc *p, uint addr, uint len)
+{
+  struct vma *v, *fv;
+  uint end, s, e;
+
+  if(addr % PGSIZE || len == 0 || addr + len < addr)
+    return -1;
+  end = PGROUNDUP(addr + len);
+  // Unmapping the middle of a mapping needs a free slot for its
+  // upper part: make sure there is one before changing anything.
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+    if(v->start && v->start < addr && v->end > end)
+      break;
+  if(v < &p->mm->vma[NVMA] && vmaslot(p) == 0)
+    return -1;
+
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++){
+    if(v->start == 0 || v->start >= end || v->end <= addr)
+      continue;
+    s = v->start > addr ? v->start : addr;
+    e = v->end < end ? v->end : end;
+    vmaunmap(p, v, s, e);
+    if(s == v->start && e == v->end){
+      if(v->f)
+        fileclose(v->f);
+      if(v->shm)
+        shmput(v->shm);
+      memset(v, 0, sizeof(*v));
+    } else if(s == v->start){
+      v->off += e - v->start;
+      v->start = e;
+    } else if(e == v->end)
+      v->end = s;
+    else {
+      fv = vmaslot(p);
+      *fv = *v;
+      fv->start = e;
+      fv->off += e - v->start;
+      if(fv->f)
+        filedup(fv->f);
+      if(fv->shm)
+        shmdup(fv->shm);
+      v->end = s;
+    }
+  }
+  return 0;
+}
+
+// Attach the shared memory segment id to the current process,
+// for reading and writing. Returns the address or -1.
+int
+shmat(int id)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  struct shm *s;
+  uint len;
+
+  if((s = shmref(id, &len)) == 0)
+    return -1;
+  acquiresleep(&p->mm->vmalock);
+  if((v = vmaslot(p)) == 0 || (v->start = vmaplace(p, len)) == 0){
+    releasesleep(&p->mm->vmalock);
+    shmput(s);
+    return -1;
+  }
+  v->end = v->start + len;
+  v->prot = PROT_READ|PROT_WRITE;
+  v->flags = MAP_SHARED;
+  v->f = 0;
+  v->off = 0;
+  v->shm = s;
+  releasesleep(&p->mm->vmalock);
+  return v->start;
+}
+
+// Detach the shared memory segment attached at addr.
+int
+shmdt(uint addr)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  int r;
+
+  acquiresleep(&p->mm->vmalock);
+  r = -1;
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+    if(v->start && v->start == addr && v->shm && !(v->flags & MAP_ANON)){
+      r = unmap(p, v->start, v->end - v->start);
+      break;
+    }
+  releasesleep(&p->mm->vmalock);
+  return r;
+}
+
+// Unmap the pages in [addr, addr+len) of the current process.
+int
+munmap(uint addr, uint len)
+{
+  struct proc *p = myproc();
+  int r;
+
+  acquiresleep(&p->mm->vmalock);
+  r = unmap(p, addr, len);
+  releasesleep(&p->mm->vmalock);
+  return r;
+}
+
+// Write the dirty pages of shared file mappings in [addr,
+// addr+len) back to their files.
+int
+msync(uint addr, uint len)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint end;
+
+  if(addr % PGSIZE || addr + len < addr)
+    return -1;
+  end = PGROUNDUP(addr + len);
+  acquiresleep(&p->mm->vmalock);
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+    if(v->start && v->start < end && v->end > addr)
+      vmasync(p, v, v->start > addr ? v->start : addr, v->end < end ? v->end : end);
+  releasesleep(&p->mm->vmalock);
+  return 0;
+}
+
+// Drop all the mappings of p, on exit() and exec(), when no other
+// thread uses them.
+void
+vmaclear(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++){
+    if(v->start == 0)
+      continue;
+    vmaunmap(p, v, v->start, v->end);
+    if(v->f)
+      fileclose(v->f);
+    if(v->shm)
+      shmput(v->shm);
+    memset(v, 0, sizeof(*v));
+  }
+}
+
+// Copy the mappings of p to np. Called with p->mm->vmalock held.
+static int
+dup(struct proc *np, struct proc *p)
+{
+  struct vma *v, *nv;
+  pte_t *pte;
+  char *mem, *page;
+  uint a, flags;
+
+  for(v = p->mm->vma, nv = np->mm->vma; v < &p->mm->vma[NVMA]; v++, nv++){
+    if(v->start == 0)
+      continue;
+    *nv = *v;
+    if(nv->f)
+      filedup(nv->f);
+    if(nv->shm)
+      shmdup(nv->shm);
+    for(a = v->start; a < v->end; a += PGSIZE){
+      pte = walkpgdir(p->pgdir, (void*)a, 0);
+      if(pte == 0 || !(*pte & PTE_P))
+        continue;
+      page = P2V(PTE_ADDR(*pte));
+      flags = PTE_FLAGS(*pte) & ~PTE_D;
+      if(!(v->flags & MAP_SHARED)){
+        if((mem = kalloc()) == 0)
+          return -1;
+        memmove(mem, page, PGSIZE);
+      } else if(v->f){
+        // One pin per mapping of the block.
+        ilock_shared(v->f->ip);
+        mem = ipin(v->f->ip, v->off + (a - v->start));
+        iunlock_shared(v->f->ip);
+        if(mem != page)
+          panic("vmadup");
+        xadd(&npinned, 1);
+        kref(mem);
+      } else {
+        mem = page;
+        kref(mem);
+      }
+      if(mappages(np->pgdir, (void*)a, PGSIZE, V2P(mem), flags) < 0){
+        kfree(mem);
+        if(v->f && (v->flags & MAP_SHARED)){
+          ilock_shared(v->f->ip);
+          iunpin(v->f->ip, v->off + (a - v->start));
+          iunlock_shared(v->f->ip);
+          xadd(&npinned, -1);
+        }
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+// Give np the mappings of p, on fork(). Private pages are copied,
+// shared ones are mapped in both. Returns -1 if out of memory;
+// the caller then calls vmaclear(np).
+int
+vmadup(struct proc *np, struct proc *p)
+{
+  int r;
+
+  acquiresleep(&p->mm->vmalock);
+  r = dup(np, p);
+  releasesleep(&p->mm->vmalock);
+  return r;
+}
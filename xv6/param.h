@@ -2,15 +2,22 @@
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
+#define NIOV         16  // max buffers of one readv()/writev()
+#define IOVMAX  0x40000000  // max total bytes of one readv()/writev()
+#define NVMA         16  // mmap() mappings per process
+#define NSHM         16  // shared memory segments per system
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
+#define NDCACHE     128  // entries of the directory name lookup cache
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE      65  // blocks mkfs gives the on-disk log (header + 64)
+#define LOGDELAY     1  // ticks a transaction stays open for group commit
+#define NBUF         4096  // max size of disk block cache (grows on demand)
+#define FSSIZE       2000  // size of file system in blocks
+#define NLOCKSTAT    (2*NINODE + 160)  // max locks tracked by lockstat: 2 per i-node, plus bcache and futex buckets and the rest
 
 /* --- Boletín 3. Ejercicio 1. --- */
 #define NUM_PRIO     2   // Cantidad de colas de procesos según prioridad que tiene el kernel
\ No newline at end of file
@@ -6,19 +6,135 @@
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "mm.h"
 #include "file.h"
+#include "fcntl.h"
 
-#define PIPESIZE 512
+#define PIPESIZE     PGSIZE  // default ring size
+#define PIPEMAXPAGES 16      // largest ring, in pages
 
+// The ring is size bytes over size/PGSIZE pages, size being a power
+// of two, and data moves in and out of it with memmove() a page at
+// a time. A reader sleeps only while the pipe is empty and a writer
+// only while it is full, so the writer wakes readers only when the
+// pipe stops being empty, and the reader wakes writers only once
+// half of the ring is free again, not on every byte that moves.
+//
+// Whole pages move by reference when both the user buffer and the
+// ring position are page-aligned: pipewrite() puts the writer's page
+// in the ring, made copy-on-write in the writer, and piperead() maps
+// a ring page copy-on-write in the reader. So a ring page may be
+// shared, and the pipe copies it before writing to it (ringown()).
+// Only heap pages (below sz) of processes without other threads
+// move (see canflip()); mmap() pages are copied.
+//
+// Processes in poll() wait on pollers, and hear when the pipe stops
+// being empty or full, or an end closes (pipenotify()).
+//
+// splice() moves data between a pipe and a file through the ring
+// with the pipe lock released; wbusy or rbusy then keep other
+// writers or readers away from the ring.
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *page[PIPEMAXPAGES];
+  uint size;      // ring size in bytes
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rwait;      // readers asleep on nread
+  int wwait;      // writers asleep on nwrite
+  int rbusy;      // splice() is reading from the ring
+  int wbusy;      // splice() is writing to the ring
+  struct pollq pollers;  // processes in poll() on either end
 };
 
+// Tell the processes polling p that it changed. Caller holds
+// p->lock.
+static void
+pipenotify(struct pipe *p)
+{
+  if(p->pollers.head)
+    pollwakeup(&p->pollers);
+}
+
+// Whether the user page at va may move by reference: it must be
+// a heap page, and no other thread may share the page table, as
+// their TLBs could keep it writable after it becomes
+// copy-on-write (see mm.h).
+static int
+canflip(uint va)
+{
+  struct mm *mm = myproc()->mm;
+
+  return va + PGSIZE <= mm->sz && mm->ref == 1;
+}
+
+// Make ring page i private to the pipe before writing to it.
+static int
+ringown(struct pipe *p, int i)
+{
+  char *mem;
+
+  if(krefcount(p->page[i]) == 1)
+    return 0;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, p->page[i], PGSIZE);
+  kfree(p->page[i]);
+  p->page[i] = mem;
+  return 0;
+}
+
+// Copy n bytes between addr and the ring at byte position pos.
+// Returns -1 if there is no memory to unshare a ring page.
+static int
+ringcopy(struct pipe *p, uint pos, char *addr, int n, int toring)
+{
+  uint off, m;
+
+  while(n > 0){
+    off = pos & (p->size - 1);
+    m = PGSIZE - off % PGSIZE;
+    if(m > n)
+      m = n;
+    if(toring){
+      if(ringown(p, off / PGSIZE) < 0)
+        return -1;
+      memmove(p->page[off / PGSIZE] + off % PGSIZE, addr, m);
+    } else
+      memmove(addr, p->page[off / PGSIZE] + off % PGSIZE, m);
+    pos += m;
+    addr += m;
+    n -= m;
+  }
+  return 0;
+}
+
+static void
+freepages(char **page, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    kfree(page[i]);
+}
+
+// Allocate n pages into page[]; 0 on success, -1 if out of memory.
+static int
+allocpages(char **page, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if((page[i] = kalloc()) == 0){
+      freepages(page, i);
+      return -1;
+    }
+  }
+  return 0;
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -30,10 +146,21 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((p = (struct pipe*)kalloc()) == 0)
     goto bad;
+  if(allocpages(p->page, PIPESIZE / PGSIZE) < 0){
+    kfree((char*)p);
+    p = 0;
+    goto bad;
+  }
+  p->size = PIPESIZE;
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
   p->nread = 0;
+  p->rwait = 0;
+  p->wwait = 0;
+  p->rbusy = 0;
+  p->wbusy = 0;
+  p->pollers.head = 0;
   initlock(&p->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -47,8 +174,10 @@ pipealloc(struct file **f0, struct file **f1)
 
 //PAGEBREAK: 20
  bad:
-  if(p)
+  if(p){
+    freepages(p->page, p->size / PGSIZE);
     kfree((char*)p);
+  }
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -67,55 +196,306 @@ pipeclose(struct pipe *p, int writable)
     p->readopen = 0;
     wakeup(&p->nwrite);
   }
+  pipenotify(p);
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
+    freepages(p->page, p->size / PGSIZE);
     kfree((char*)p);
   } else
     release(&p->lock);
 }
 
+// Resize the ring of p to n bytes, rounded up to a power of two
+// number of pages. Fails if the data in the pipe would not fit or
+// splice() is using the ring. Returns the new size.
+int
+pipesetsize(struct pipe *p, int n)
+{
+  char *page[PIPEMAXPAGES], *old[PIPEMAXPAGES];
+  uint size, oldsize, len, off;
+
+  if(n <= 0 || n > PIPEMAXPAGES*PGSIZE)
+    return -1;
+  for(size = PGSIZE; size < n; size *= 2)
+    ;
+  if(allocpages(page, size / PGSIZE) < 0)
+    return -1;
+
+  acquire(&p->lock);
+  len = p->nwrite - p->nread;
+  if(len > size || p->rbusy || p->wbusy){
+    release(&p->lock);
+    freepages(page, size / PGSIZE);
+    return -1;
+  }
+  // Move the data to the start of the new ring.
+  for(off = 0; off < len; off += PGSIZE)
+    ringcopy(p, p->nread + off, page[off / PGSIZE],
+             len - off < PGSIZE ? len - off : PGSIZE, 0);
+  memmove(old, p->page, sizeof(old));
+  oldsize = p->size;
+  memmove(p->page, page, sizeof(page));
+  p->size = size;
+  p->nread = 0;
+  p->nwrite = len;
+  if(p->wwait)
+    wakeup(&p->nwrite);
+  pipenotify(p);
+  release(&p->lock);
+
+  freepages(old, oldsize / PGSIZE);
+  return size;
+}
+
+int
+pipegetsize(struct pipe *p)
+{
+  return p->size;
+}
+
+// Whether p has no data to read right now.
+int
+pipeempty(struct pipe *p)
+{
+  int r;
+
+  acquire(&p->lock);
+  r = p->nread == p->nwrite;
+  release(&p->lock);
+  return r;
+}
+
 //PAGEBREAK: 40
 int
 pipewrite(struct pipe *p, char *addr, int n)
 {
-  int i;
+  int i, m;
+  uint off;
+  char *page;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
-    while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
+  for(i = 0; i < n; i += m){
+    while(p->nwrite == p->nread + p->size || p->wbusy){  //DOC: pipewrite-full
       if(p->readopen == 0 || myproc()->killed){
         release(&p->lock);
         return -1;
       }
-      wakeup(&p->nread);
+      p->wwait++;
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+      p->wwait--;
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    if(p->nwrite == p->nread){  //DOC: pipewrite-wakeup1
+      if(p->rwait)
+        wakeup(&p->nread);
+      pipenotify(p);
+    }
+    m = p->nread + p->size - p->nwrite;
+    if(m > n - i)
+      m = n - i;
+    off = p->nwrite & (p->size - 1);
+    if(m >= PGSIZE && off % PGSIZE == 0 && (uint)(addr + i) % PGSIZE == 0 &&
+       canflip((uint)(addr + i)) &&
+       (page = uvmshare(myproc()->pgdir, (uint)(addr + i))) != 0){
+      // The ring page is free: take the writer's page instead.
+      kfree(p->page[off / PGSIZE]);
+      p->page[off / PGSIZE] = page;
+      m = PGSIZE;
+    } else if(ringcopy(p, p->nwrite, addr + i, m, 1) < 0){
+      release(&p->lock);
+      return i > 0 ? i : -1;
+    }
+    p->nwrite += m;
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
   release(&p->lock);
   return n;
 }
 
+// Count n bytes as read from p and wake writers if half of the
+// ring has become free. Caller holds p->lock.
+static void
+pipeconsume(struct pipe *p, int n)
+{
+  uint free;
+
+  free = p->size - (p->nwrite - p->nread);
+  p->nread += n;
+  if(p->wwait && free < p->size/2 && free + n >= p->size/2)  //DOC: piperead-wakeup
+    wakeup(&p->nwrite);
+  // Pollers, unlike writers, hear as soon as there is room.
+  if(free == 0 && n > 0)
+    pipenotify(p);
+}
+
 int
 piperead(struct pipe *p, char *addr, int n)
 {
-  int i;
+  int i, m;
+  uint off;
 
   acquire(&p->lock);
-  while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
+  while((p->nread == p->nwrite && p->writeopen) || p->rbusy){  //DOC: pipe-empty
     if(myproc()->killed){
       release(&p->lock);
       return -1;
     }
+    p->rwait++;
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
+    p->rwait--;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  if(n > p->nwrite - p->nread)
+    n = p->nwrite - p->nread;
+  for(i = 0; i < n; i += m){  //DOC: piperead-copy
+    off = (p->nread + i) & (p->size - 1);
+    m = n - i;
+    if(m >= PGSIZE && off % PGSIZE == 0 && (uint)(addr + i) % PGSIZE == 0 &&
+       canflip((uint)(addr + i)) &&
+       uvmmap(myproc()->pgdir, (uint)(addr + i), p->page[off / PGSIZE]) == 0)
+      m = PGSIZE;
+    else {
+      if(m > PGSIZE - off % PGSIZE)
+        m = PGSIZE - off % PGSIZE;
+      ringcopy(p, p->nread + i, addr + i, m, 0);
+    }
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  pipeconsume(p, n);
   release(&p->lock);
-  return i;
+  return n;
+}
+
+// poll() on the read end (writable == 0) or the write end of p:
+// what is ready now, and if e is not 0, put e on the queue of p.
+// Readiness ignores splice() holding the ring: a read or write
+// then only waits for it to finish.
+int
+pipepoll(struct pipe *p, int writable, struct pollent *e)
+{
+  int r;
+
+  if(e)
+    pollwait(&p->pollers, e);
+  r = 0;
+  acquire(&p->lock);
+  if(writable){
+    if(p->readopen == 0)
+      r |= POLLERR;
+    else if(p->nwrite != p->nread + p->size)
+      r |= POLLOUT;
+  } else {
+    if(p->nread != p->nwrite)
+      r |= POLLIN;
+    if(p->writeopen == 0)
+      r |= POLLHUP;
+  }
+  release(&p->lock);
+  return r;
+}
+
+// splice() from the inode file f to p: read up to n bytes of f
+// straight into the ring. Returns the number of bytes moved.
+int
+pipefill(struct pipe *p, struct file *f, int n)
+{
+  int done, m, r;
+  uint off;
+  char *dst;
+
+  for(done = 0; done < n; done += r){
+    acquire(&p->lock);
+    while(p->nwrite == p->nread + p->size || p->wbusy){
+      if(p->readopen == 0 || myproc()->killed){
+        release(&p->lock);
+        return done > 0 ? done : -1;
+      }
+      p->wwait++;
+      sleep(&p->nwrite, &p->lock);
+      p->wwait--;
+    }
+    off = p->nwrite & (p->size - 1);
+    m = p->nread + p->size - p->nwrite;
+    if(m > PGSIZE - off % PGSIZE)
+      m = PGSIZE - off % PGSIZE;
+    if(m > n - done)
+      m = n - done;
+    if(ringown(p, off / PGSIZE) < 0){
+      release(&p->lock);
+      return done > 0 ? done : -1;
+    }
+    dst = p->page[off / PGSIZE] + off % PGSIZE;
+    p->wbusy = 1;
+    release(&p->lock);
+
+    r = fileread(f, dst, m);
+
+    acquire(&p->lock);
+    p->wbusy = 0;
+    if(r > 0){
+      if(p->nwrite == p->nread){
+        if(p->rwait)
+          wakeup(&p->nread);
+        pipenotify(p);
+      }
+      p->nwrite += r;
+    }
+    if(p->wwait)
+      wakeup(&p->nwrite);
+    release(&p->lock);
+    if(r < 0)
+      return done > 0 ? done : -1;
+    if(r < m)
+      return done + r;
+  }
+  return done;
+}
+
+// splice() from p to the inode file f: write up to n bytes from
+// the ring to f. Waits for data only if the pipe is empty at first.
+// Returns the number of bytes moved.
+int
+pipedrain(struct pipe *p, struct file *f, int n)
+{
+  int done, m, r;
+  uint off;
+  char *page;
+
+  for(done = 0; done < n; done += r){
+    acquire(&p->lock);
+    while((p->nread == p->nwrite && p->writeopen && done == 0) || p->rbusy){
+      if(myproc()->killed){
+        release(&p->lock);
+        return done > 0 ? done : -1;
+      }
+      p->rwait++;
+      sleep(&p->nread, &p->lock);
+      p->rwait--;
+    }
+    if(p->nread == p->nwrite){
+      release(&p->lock);
+      break;
+    }
+    off = p->nread & (p->size - 1);
+    m = p->nwrite - p->nread;
+    if(m > PGSIZE - off % PGSIZE)
+      m = PGSIZE - off % PGSIZE;
+    if(m > n - done)
+      m = n - done;
+    // Hold the page: a writer may replace it in the ring meanwhile.
+    page = p->page[off / PGSIZE];
+    kref(page);
+    p->rbusy = 1;
+    release(&p->lock);
+
+    r = filewrite(f, page + off % PGSIZE, m);
+    kfree(page);
+
+    acquire(&p->lock);
+    p->rbusy = 0;
+    if(r > 0)
+      pipeconsume(p, r);
+    if(p->rwait)
+      wakeup(&p->nread);
+    release(&p->lock);
+    if(r < 0)
+      return done > 0 ? done : -1;
+  }
+  return done;
 }
@@ -0,0 +1,187 @@
+// poll(): wait until one of several files is ready.
+//
+// A process in poll() puts a pollent for each file on the queue of
+// the pipe or device behind it (pollwait()), then checks which
+// files are ready.  Whoever later makes one of them ready calls
+// pollwakeup() on the queue, which wakes just the processes on it
+// with wakeproc(), without scanning the process table.  Entries go
+// on the queues before the check, so a change between the check and
+// the sleep is not lost.  Regular files and directories are always
+// ready and have no queue.
+//
+// Pollers with a timeout are also on a list that the timer
+// interrupt looks at (polltick()).  All queues and the list are
+// protected by polllock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+
+struct poller {
+  struct proc *p;
+  int ready;            // something it waits for changed
+  uint deadline;        // tick to give up at, if timed
+  struct poller *next;  // on the timed list
+};
+
+static struct spinlock polllock;
+static struct poller *timed;
+
+extern uint ticks;
+
+void
+pollinit(void)
+{
+  initlock(&polllock, "poll");
+}
+
+// Put e on q, for its poller to hear of changes.
+void
+pollwait(struct pollq *q, struct pollent *e)
+{
+  acquire(&polllock);
+  e->q = q;
+  e->next = q->head;
+  q->head = e;
+  release(&polllock);
+}
+
+// Wake the processes polling q.  Callers test q->head first,
+// under the lock that protects the state of the file: a poller
+// is on q before it checks that state under the same lock.
+void
+pollwakeup(struct pollq *q)
+{
+  struct pollent *e;
+
+  acquire(&polllock);
+  for(e = q->head; e; e = e->next){
+    e->pl->ready = 1;
+    wakeproc(e->pl->p, e->pl);
+  }
+  release(&polllock);
+}
+
+// Wake the pollers whose timeout has expired.
+// Called by the timer interrupt on every tick.
+void
+polltick(void)
+{
+  struct poller *pl;
+
+  if(timed == 0)
+    return;
+  acquire(&polllock);
+  for(pl = timed; pl; pl = pl->next)
+    if((int)(ticks - pl->deadline) >= 0)
+      wakeproc(pl->p, pl);
+  release(&polllock);
+}
+
+// What is ready in f now, and if e is not 0, put e on the
+// queue of f.
+static int
+filepoll(struct file *f, struct pollent *e)
+{
+  struct inode *ip;
+
+  if(f->type == FD_PIPE)
+    return pipepoll(f->pipe, f->writable, e);
+  if(f->type == FD_INODE){
+    ip = f->ip;
+    // major is set once, when the device node is created.
+    if(ip->type == T_DEV && ip->major >= 0 && ip->major < NDEV &&
+       devsw[ip->major].poll)
+      return devsw[ip->major].poll(ip, e);
+    return (f->readable ? POLLIN : 0) | (f->writable ? POLLOUT : 0);
+  }
+  panic("filepoll");
+}
+
+// Wait until one of the nfds files of fds has one of the events
+// it asks for, or timeout ticks pass (forever if timeout is
+// negative), and set revents.  Returns how many files have
+// events, 0 on timeout, or -1.
+int
+poll(struct pollfd *fds, int nfds, int timeout)
+{
+  struct proc *curproc = myproc();
+  struct file *f[NOFILE];
+  struct pollent ent[NOFILE];
+  struct pollent **pp;
+  struct poller pl, **ppl;
+  int i, n, r, fd, first, expired;
+
+  if(nfds < 0 || nfds > NOFILE)
+    return -1;
+  pl.p = curproc;
+  pl.ready = 0;
+  for(i = 0; i < nfds; i++){
+    f[i] = 0;
+    ent[i].pl = &pl;
+    ent[i].q = 0;
+    fd = fds[i].fd;
+    // Hold the files: a thread may close the fds meanwhile.
+    if(fd >= 0 && fd < NOFILE && curproc->ofile[fd])
+      f[i] = filedup(curproc->ofile[fd]);
+  }
+
+  expired = 0;
+  for(first = 1;; first = 0){
+    n = 0;
+    for(i = 0; i < nfds; i++){
+      if(fds[i].fd < 0)
+        r = 0;
+      else if(f[i] == 0)
+        r = POLLNVAL;
+      else
+        r = filepoll(f[i], first && timeout != 0 ? &ent[i] : 0) &
+            (fds[i].events | POLLERR | POLLHUP);
+      fds[i].revents = r;
+      if(r)
+        n++;
+    }
+    if(n > 0 || timeout == 0 || expired || curproc->killed)
+      break;
+    acquire(&polllock);
+    if(first && timeout > 0){
+      pl.deadline = ticks + timeout;
+      pl.next = timed;
+      timed = &pl;
+    }
+    while(!pl.ready && !curproc->killed &&
+          (timeout < 0 || (int)(ticks - pl.deadline) < 0))
+      sleep(&pl, &polllock);
+    expired = !pl.ready;
+    pl.ready = 0;
+    release(&polllock);
+  }
+
+  acquire(&polllock);
+  for(i = 0; i < nfds; i++){
+    if(ent[i].q == 0)
+      continue;
+    for(pp = &ent[i].q->head; *pp != &ent[i]; pp = &(*pp)->next)
+      ;
+    *pp = ent[i].next;
+  }
+  if(timeout > 0 && !first)
+    for(ppl = &timed; *ppl; ppl = &(*ppl)->next)
+      if(*ppl == &pl){
+        *ppl = pl.next;
+        break;
+      }
+  release(&polllock);
+  for(i = 0; i < nfds; i++)
+    if(f[i])
+      fileclose(f[i]);
+  return curproc->killed ? -1 : n;
+}
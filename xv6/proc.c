@@ -6,6 +6,9 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
+#include "iostat.h"
 
 struct {
   struct spinlock lock;
@@ -14,6 +17,7 @@ struct {
   /* --- Boletín 3. Ejercicio 1. --- */
   struct proc *queue[NUM_PRIO];
 
+  uint nswitch;         // Veces que el planificador ha cambiado a un proceso.
 } ptable;
 
 /* --- Boletín 3. Ejercicio 1. --- */
@@ -104,19 +108,20 @@ cpuid() {
   return mycpu()-cpus;
 }
 
+// Find this cpu's entry in cpus[] by its LAPIC id.
+// Only used by seginit() before %gs is set up, and by lockbench().
 // Must be called with interrupts disabled to avoid the caller being
 // rescheduled between reading lapicid and running through the loop.
 struct cpu*
-mycpu(void)
+findcpu(void)
 {
   int apicid, i;
 
   if(readeflags()&FL_IF)
-    panic("mycpu called with interrupts enabled\n");
+    panic("findcpu called with interrupts enabled\n");
 
   apicid = lapicid();
-  // APIC IDs are not guaranteed to be contiguous. Maybe we should have
-  // a reverse map, or reserve a register to store &cpus[i].
+  // APIC IDs are not guaranteed to be contiguous.
   for (i = 0; i < ncpu; ++i) {
     if (cpus[i].apicid == apicid)
       return &cpus[i];
@@ -124,19 +129,48 @@ mycpu(void)
   panic("unknown apicid\n");
 }
 
-// Disable interrupts so that we are not rescheduled
-// while reading proc from the cpu structure
+// seginit() makes %gs point at this cpu's struct cpu.
+// Must be called with interrupts disabled to avoid the caller being
+// rescheduled and then using another cpu's structure.
+struct cpu*
+mycpu(void)
+{
+  struct cpu *c;
+
+  if(readeflags()&FL_IF)
+    panic("mycpu called with interrupts enabled\n");
+
+  asm volatile("movl %%gs:%c1, %0" : "=r" (c) :
+               "i" (__builtin_offsetof(struct cpu, self)));
+  return c;
+}
+
+// Reading c->proc through %gs is a single instruction, so we can't
+// be rescheduled halfway and there is no need for pushcli().
 struct proc*
 myproc(void) {
-  struct cpu *c;
   struct proc *p;
-  pushcli();
-  c = mycpu();
-  p = c->proc;
-  popcli();
+
+  asm volatile("movl %%gs:%c1, %0" : "=r" (p) :
+               "i" (__builtin_offsetof(struct cpu, proc)));
   return p;
 }
 
+// A new empty address space, with one reference.
+static struct mm*
+mmalloc(void)
+{
+  struct mm *mm;
+
+  if((mm = (struct mm*)kalloc()) == 0)
+    return 0;
+  memset(mm, 0, sizeof(*mm));
+  initlock(&mm->lock, "mm");
+  initsleeplock(&mm->vmalock, "vma");
+  mm->ref = 1;
+  return mm;
+}
+
 //PAGEBREAK: 32
 // Look in the process table for an UNUSED proc.
 // If found, change state to EMBRYO and initialize
@@ -160,6 +194,10 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->nsyscall = 0;
+  p->mm = 0;
+  p->isthread = 0;
+  p->ustack = 0;
 
   release(&ptable.lock);
 
@@ -198,10 +236,10 @@ userinit(void)
   p = allocproc();
 
   initproc = p;
-  if((p->pgdir = setupkvm()) == 0)
+  if((p->mm = mmalloc()) == 0 || (p->pgdir = setupkvm()) == 0)
     panic("userinit: out of memory?");
   inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
-  p->sz = PGSIZE;
+  p->mm->sz = PGSIZE;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
@@ -233,25 +271,88 @@ userinit(void)
   release(&ptable.lock);
 }
 
-// Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
+// A kernel thread's very first scheduling by scheduler()
+// will swtch here.  Returning jumps to the thread's function,
+// which kthread() left where forkret() would find trapret.
+static void
+kthreadstart(void)
+{
+  // Still holding ptable.lock from scheduler.
+  release(&ptable.lock);
+}
+
+// Start a kernel thread running fn(), which must never return.
+// It has no user memory and runs on the kernel page table.
+// Returns its pid, or -1 on failure.
+int
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    return -1;
+  if((p->mm = mmalloc()) == 0 || (p->pgdir = setupkvm()) == 0){
+    if(p->mm)
+      kfree((char*)p->mm);
+    kfree(p->kstack);
+    p->kstack = 0;
+    p->state = UNUSED;
+    return -1;
+  }
+  p->context->eip = (uint)kthreadstart;
+  *(uint*)(p->context + 1) = (uint)fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+  p->state = RUNNABLE;
+  p->priority = NORM_PRIO;
+  p->previous = NULL;
+  p->next = NULL;
+  enqueue(p);
+  release(&ptable.lock);
+
+  return p->pid;
+}
+
+// Grow current process's memory by n bytes: lazily, the pages
+// are allocated by the page fault handler, or freeing them if n
+// is negative.  The threads of a process may call it at once.
+// Return the old size, or -1 on failure.
 int
 growproc(int n)
 {
   uint sz;
   struct proc *curproc = myproc();
+  struct mm *mm = curproc->mm;
 
-  sz = curproc->sz;
+  acquiresleep(&mm->vmalock);
+  acquire(&mm->lock);
+  sz = mm->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
-      return -1;
+    // The heap may grow up to the lowest mmap() mapping.
+    if(sz + n < sz || sz + n >= vmabase(curproc))
+      goto bad;
+    mm->sz = sz + n;
   } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
-      return -1;
+    if(-n > sz)
+      goto bad;
+    // Faults above the new size now fail, and vmalock keeps other
+    // sbrk() calls away: the pages can be freed without mm->lock,
+    // after the other CPUs running threads have dropped them.
+    mm->sz = sz + n;
+    release(&mm->lock);
+    uvmunmap(curproc->pgdir, mm, sz + n, sz);
+    releasesleep(&mm->vmalock);
+    return sz;
   }
-  curproc->sz = sz;
-  lcr3(V2P(curproc->pgdir));  // Invalidate TLB.
-  return 0;
+  release(&mm->lock);
+  releasesleep(&mm->vmalock);
+  return sz;
+
+bad:
+  release(&mm->lock);
+  releasesleep(&mm->vmalock);
+  return -1;
 }
 
 // Create a new process copying p as the parent.
@@ -270,13 +371,32 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+  if((np->mm = mmalloc()) == 0){
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+  acquire(&curproc->mm->lock);
+  np->pgdir = copyuvm(curproc->pgdir, curproc->mm->sz);
+  np->mm->sz = curproc->mm->sz;
+  release(&curproc->mm->lock);
+  if(np->pgdir == 0){
+    kfree((char*)np->mm);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+  if(vmadup(np, curproc) < 0){
+    vmaclear(np);
+    freevm(np->pgdir, 1);
+    kfree((char*)np->mm);
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
     return -1;
   }
-  np->sz = curproc->sz;
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
@@ -307,6 +427,62 @@ fork(void)
   return pid;
 }
 
+// Create a thread: a new process that shares the memory of the
+// current one (see mm.h) and starts running fn(arg) on the user
+// stack [stack, stack+size), which the caller has checked.  It
+// gets its own copies of the file descriptors and of the current
+// directory, which refer to the same open files and inode.  Its
+// creator collects it with join().
+int
+clone(uint fn, uint arg, uint stack, uint size)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *curproc = myproc();
+  uint sp, ustack[2];
+
+  if((np = allocproc()) == 0)
+    return -1;
+
+  np->pgdir = curproc->pgdir;
+  kref((char*)np->pgdir);
+  np->mm = curproc->mm;
+  np->isthread = 1;
+  np->ustack = stack;
+  np->parent = curproc;
+  *np->tf = *curproc->tf;
+
+  // fn(arg) returns to an address that faults: threads end with
+  // exit().
+  sp = ((stack + size) & ~0xf) - sizeof(ustack);
+  ustack[0] = 0xffffffff;
+  ustack[1] = arg;
+  memmove((void*)sp, ustack, sizeof(ustack));
+  np->tf->esp = sp;
+  np->tf->eip = fn;
+  np->tf->eax = 0;
+
+  for(i = 0; i < NOFILE; i++)
+    if(curproc->ofile[i])
+      np->ofile[i] = filedup(curproc->ofile[i]);
+  np->cwd = idup(curproc->cwd);
+
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+
+  np->mm->ref++;
+  np->state = RUNNABLE;
+  np->priority = curproc->priority;
+  enqueue(np);
+
+  release(&ptable.lock);
+
+  return pid;
+}
+
 /* --- Boletín 1. Ejercicio 3. --- */
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
@@ -316,11 +492,22 @@ exit(int status)
 {
   struct proc *curproc = myproc();
   struct proc *p;
-  int fd;
+  int fd, last;
 
   if(curproc == initproc)
     panic("init exiting");
 
+  // The last thread using the memory unmaps mmap() mappings,
+  // writing shared pages back, and frees it below.  Only the
+  // threads using it add references, so a ref of 1 stays 1.
+  acquire(&ptable.lock);
+  last = curproc->mm->ref == 1;
+  if(!last)
+    curproc->mm->ref--;
+  release(&ptable.lock);
+  if(last)
+    vmaclear(curproc);
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
@@ -349,7 +536,11 @@ exit(int status)
   }
 
   // Optimize by removing user part
-  deallocuvm(curproc->pgdir, KERNBASE, 0);
+  if(last){
+    deallocuvm(curproc->pgdir, KERNBASE, 0);
+    kfree((char*)curproc->mm);
+  }
+  curproc->mm = 0;
 
   // Jump into the scheduler, never to return.
   curproc->state = ZOMBIE;
@@ -361,6 +552,31 @@ exit(int status)
   panic("zombie exit");
 }
 
+// Free the ZOMBIE process p for wait() or join().
+// Called with ptable.lock held.
+static void
+freeproc(struct proc *p)
+{
+  myproc()->nsyscall += p->nsyscall;
+  kfree(p->kstack);
+  p->kstack = 0;
+  freevm(p->pgdir, 0); // User zone deleted before
+  p->pgdir = 0;
+  p->pid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  p->killed = 0;
+  p->isthread = 0;
+  p->state = UNUSED;
+
+  /* --- Boletín 3. Ejercicio 1. --- */
+  /* Al liberarse el proceso limpiamos su prioridad, y procesos siguiente y previo. */
+  /* Esto implica que todas las entradas para procesos no usados tendrán prioridad alta y siempre tendrán los punteros a procesos a NULL. */
+  p->priority = 0;
+  p->next = NULL;
+  p->previous = NULL;
+}
+
 /* --- Boletín 1. Ejercicio 3. --- */
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
@@ -378,31 +594,21 @@ wait(int *status)
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
       if(p->parent != curproc)
         continue;
+      // Threads are collected by join(); init collects the
+      // orphaned ones too.
+      if(p->isthread && curproc != initproc)
+        continue;
       havekids = 1;
       if(p->state == ZOMBIE){
         // Found one.
         pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir, 0); // User zone deleted before
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
-
-        /* --- Boletín 3. Ejercicio 1. --- */
-        /* Al liberarse el proceso limpiamos su prioridad, y procesos siguiente y previo. */
-        /* Esto implica que todas las entradas para procesos no usados tendrán prioridad alta y siempre tendrán los punteros a procesos a NULL. */
-        p->priority = 0;
-        p->next = NULL;
-        p->previous = NULL;
 
         /* --- Boletín 1. Ejercicio 3. --- */
         /* Si el puntero no es nulo podemos copiar el estado de salida al puntero dado. */
         if (status != NULL)
           *status = p->status;
 
+        freeproc(p);
         release(&ptable.lock);
         return pid;
       }
@@ -419,6 +625,43 @@ wait(int *status)
   }
 }
 
+// Wait for the thread tid (any, if tid is 0) that the current
+// process created with clone() to exit. Return its pid and put
+// the stack it got from clone() in *stack, or -1 if there is no
+// such thread.
+int
+join(int tid, uint *stack)
+{
+  struct proc *p;
+  int havekids, pid;
+  struct proc *curproc = myproc();
+
+  acquire(&ptable.lock);
+  for(;;){
+    havekids = 0;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(p->parent != curproc || !p->isthread || (tid && p->pid != tid))
+        continue;
+      havekids = 1;
+      if(p->state == ZOMBIE){
+        pid = p->pid;
+        *stack = p->ustack;
+        freeproc(p);
+        release(&ptable.lock);
+        return pid;
+      }
+    }
+
+    if(!havekids || curproc->killed){
+      release(&ptable.lock);
+      return -1;
+    }
+
+    // Sleep like wait(): exit() wakes up the parent.
+    sleep(curproc, &ptable.lock);
+  }
+}
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
@@ -458,8 +701,10 @@ scheduler(void)
       /* Una vez se pone en ejecución el proceso se saca de la cola. */
       dequeue(p);
       
+      ptable.nswitch++;
       swtch(&(c->scheduler), p->context);
       switchkvm();
+      c->mm = 0;
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
@@ -526,8 +771,9 @@ forkret(void)
     // of a regular process (e.g., they call sleep), and thus cannot
     // be run from main().
     first = 0;
-    iinit(ROOTDEV);
+    // Recover the log first: iinit() summarizes the free bitmap.
     initlog(ROOTDEV);
+    iinit(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).
@@ -600,6 +846,20 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Wake up p if it is sleeping on chan, without scanning the
+// process table: for sleepers whose waker knows who they are
+// (see futex.c).
+void
+wakeproc(struct proc *p, void *chan)
+{
+  acquire(&ptable.lock);
+  if(p->state == SLEEPING && p->chan == chan){
+    p->state = RUNNABLE;
+    enqueue(p);
+  }
+  release(&ptable.lock);
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
@@ -721,3 +981,13 @@ procdump(void)
     cprintf("\n");
   }
 }
+
+/* Copia al usuario el número de cambios de contexto y de llamadas al sistema del proceso. */
+void
+procstat(struct iostat *st)
+{
+  acquire(&ptable.lock);
+  st->nswitch = ptable.nswitch;
+  st->nsyscall = myproc()->nsyscall;
+  release(&ptable.lock);
+}
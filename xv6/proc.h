@@ -8,6 +8,9 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  struct cpu *self;            // &cpus[i], read through %gs by mycpu()
+  struct mm *mm;               // User address space in the TLB, or 0
+  volatile uint tlbgen;        // TLB shootdowns served (see vm.c)
 };
 
 extern struct cpu cpus[NCPU];
@@ -34,9 +37,20 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+/* Una proyección de mmap() (ver mmap.c). */
+struct vma {
+  uint start;                  // Primera dirección, alineada a página; 0 si la entrada está libre.
+  uint end;                    // Dirección siguiente a la última, alineada a página.
+  int prot;                    // PROT_READ, PROT_WRITE.
+  int flags;                   // MAP_SHARED o MAP_PRIVATE, y MAP_ANON.
+  struct file *f;              // Fichero proyectado, o 0 si es anónima.
+  uint off;                    // Desplazamiento en el fichero (o en el segmento) de start.
+  struct shm *shm;             // Segmento de memoria compartida de shmat(), o 0.
+};
+
 // Per-process state
 struct proc {
-  uint sz;                     // Size of process memory (bytes)
+  struct mm *mm;               // Espacio de direcciones, compartido con sus hilos (ver mm.h).
   pde_t* pgdir;                // Page table
   char *kstack;                // Bottom of kernel stack for this process
   enum procstate state;        // Process state
@@ -58,6 +72,11 @@ struct proc {
   struct proc *previous;       // Puntero al proceso de misma prioridad que debe ser ejecutado justo antes de este.
   struct proc *next;           // Puntero al proceso de misma prioridad que será ejecutado justo después de este.
 
+  int logresv;                 // Bloques de log reservados por begin_opn() hasta end_op().
+  uint nsyscall;               // Llamadas al sistema del proceso y de los hijos ya esperados.
+  int isthread;                // Creado con clone(): lo espera join(), no wait().
+  uint ustack;                 // Hilo: pila de usuario que recibió clone(), para join().
+
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -0,0 +1,218 @@
+// Shared memory segments: shmget(), shmat(), shmdt(), shmctl().
+//
+// A segment is a run of zeroed pages, allocated on the first
+// access from any mapping, and found by its key, so unrelated
+// processes can share it; key IPC_PRIVATE always makes a new one,
+// to be shared with children.  Shared anonymous mmap() mappings
+// are backed by segments without a key (shmanon()), so a page the
+// parent never touched before fork() is still shared.
+// shmat() maps a segment as a shared mapping (see mmap.c): its
+// pages enter the page table on the first access, each with one
+// more reference (see kalloc.c), and fork() maps them in the child
+// too.  A segment is freed once it has been removed with
+// shmctl(IPC_RMID) and its last mapping is gone.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "fcntl.h"
+
+#define SHMMAXPAGES 256  // pages per segment
+
+struct shm {
+  int key;
+  int ref;        // mappings, plus one until removed; 0 if free
+  int removed;    // IPC_RMID done: shmget() no longer finds it
+  uint npages;
+  char *page[SHMMAXPAGES];
+};
+
+struct {
+  struct spinlock lock;
+  struct shm seg[NSHM];
+} shmtab;
+
+void
+shminit(void)
+{
+  initlock(&shmtab.lock, "shm");
+}
+
+// Drop one reference to s, freeing its pages with the last one.
+// Called with shmtab.lock held.
+static void
+shmfree(struct shm *s)
+{
+  uint i;
+
+  if(--s->ref > 0)
+    return;
+  for(i = 0; i < s->npages; i++)
+    if(s->page[i])
+      kfree(s->page[i]);
+  memset(s, 0, sizeof(*s));
+}
+
+// Set up the free segment s with size bytes and no pages yet.
+// Called with shmtab.lock held.
+static void
+shmsetup(struct shm *s, int key, uint size)
+{
+  uint i;
+
+  s->key = key;
+  s->ref = 1;
+  s->removed = 0;
+  s->npages = PGROUNDUP(size)/PGSIZE;
+  for(i = 0; i < s->npages; i++)
+    s->page[i] = 0;
+}
+
+// Return the id of the segment with the given key, creating it
+// with size bytes if flags has IPC_CREAT, or -1.
+int
+shmget(int key, uint size, int flags)
+{
+  struct shm *s, *free;
+
+  acquire(&shmtab.lock);
+  free = 0;
+  for(s = shmtab.seg; s < &shmtab.seg[NSHM]; s++){
+    if(s->ref == 0){
+      if(free == 0)
+        free = s;
+      continue;
+    }
+    if(key == IPC_PRIVATE || s->removed || s->key != key)
+      continue;
+    if((flags & (IPC_CREAT|IPC_EXCL)) == (IPC_CREAT|IPC_EXCL) ||
+       size > s->npages*PGSIZE){
+      release(&shmtab.lock);
+      return -1;
+    }
+    release(&shmtab.lock);
+    return s - shmtab.seg;
+  }
+  if(!(flags & IPC_CREAT) || free == 0 || size == 0 ||
+     size > SHMMAXPAGES*PGSIZE){
+    release(&shmtab.lock);
+    return -1;
+  }
+  shmsetup(free, key, size);
+  release(&shmtab.lock);
+  return free - shmtab.seg;
+}
+
+// A new segment of size bytes with no key, for a shared anonymous
+// mapping: it holds the reference of that mapping only, so it goes
+// away with the last copy of the mapping.  Returns 0 if there is
+// no free segment or size is too large.
+struct shm*
+shmanon(uint size)
+{
+  struct shm *s;
+
+  if(size == 0 || size > SHMMAXPAGES*PGSIZE)
+    return 0;
+  acquire(&shmtab.lock);
+  for(s = shmtab.seg; s < &shmtab.seg[NSHM]; s++)
+    if(s->ref == 0)
+      break;
+  if(s == &shmtab.seg[NSHM]){
+    release(&shmtab.lock);
+    return 0;
+  }
+  // Removed from the start: shmget() and shmat() never find it.
+  shmsetup(s, IPC_PRIVATE, size);
+  s->removed = 1;
+  release(&shmtab.lock);
+  return s;
+}
+
+// Mark segment id as removed: it goes away with its last mapping.
+int
+shmctl(int id, int cmd)
+{
+  struct shm *s;
+
+  if(id < 0 || id >= NSHM || cmd != IPC_RMID)
+    return -1;
+  s = &shmtab.seg[id];
+  acquire(&shmtab.lock);
+  if(s->ref == 0 || s->removed){
+    release(&shmtab.lock);
+    return -1;
+  }
+  s->removed = 1;
+  shmfree(s);
+  release(&shmtab.lock);
+  return 0;
+}
+
+// Take a reference to segment id for a new mapping, and return
+// it with its size in *size, or 0 if there is no such segment.
+struct shm*
+shmref(int id, uint *size)
+{
+  struct shm *s;
+
+  if(id < 0 || id >= NSHM)
+    return 0;
+  s = &shmtab.seg[id];
+  acquire(&shmtab.lock);
+  if(s->ref == 0 || s->removed){
+    release(&shmtab.lock);
+    return 0;
+  }
+  s->ref++;
+  *size = s->npages*PGSIZE;
+  release(&shmtab.lock);
+  return s;
+}
+
+// Take one more reference to s, for a copy of a mapping.
+void
+shmdup(struct shm *s)
+{
+  acquire(&shmtab.lock);
+  if(s->ref < 1)
+    panic("shmdup");
+  s->ref++;
+  release(&shmtab.lock);
+}
+
+// Drop the reference of a mapping to s.
+void
+shmput(struct shm *s)
+{
+  acquire(&shmtab.lock);
+  if(s->ref < 1)
+    panic("shmput");
+  shmfree(s);
+  release(&shmtab.lock);
+}
+
+// The page at offset off of s, with one more reference for the
+// page table that will map it, or 0 if out of memory.
+char*
+shmpage(struct shm *s, uint off)
+{
+  char *mem;
+
+  if(off/PGSIZE >= s->npages)
+    panic("shmpage");
+  acquire(&shmtab.lock);
+  if((mem = s->page[off/PGSIZE]) == 0){
+    if((mem = kalloc()) == 0){
+      release(&shmtab.lock);
+      return 0;
+    }
+    memset(mem, 0, PGSIZE);
+    s->page[off/PGSIZE] = mem;
+  }
+  kref(mem);
+  release(&shmtab.lock);
+  return mem;
+}
@@ -16,6 +16,8 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->readers = 0;
+  lk->wwaiting = 0;
   lk->pid = 0;
 }
 
@@ -23,9 +25,12 @@ void
 acquiresleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
-  while (lk->locked) {
+  /* Mientras espera, el escritor impide que entren lectores nuevos. */
+  lk->wwaiting++;
+  while (lk->locked || lk->readers > 0) {
     sleep(lk, &lk->lk);
   }
+  lk->wwaiting--;
   lk->locked = 1;
   lk->pid = myproc()->pid;
   release(&lk->lk);
@@ -52,5 +57,38 @@ holdingsleep(struct sleeplock *lk)
   return r;
 }
 
+/* Toma el cerrojo en modo compartido. Varios lectores pueden tenerlo a la vez, pero no entran mientras lo tenga o lo espere un escritor. */
+void
+acquiresleep_shared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  while (lk->locked || lk->wwaiting > 0) {
+    sleep(lk, &lk->lk);
+  }
+  lk->readers++;
+  release(&lk->lk);
+}
+
+void
+releasesleep_shared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if (lk->readers < 1)
+    panic("releasesleep_shared");
+  /* El último lector despierta a los escritores que esperan. */
+  if (--lk->readers == 0)
+    wakeup(lk);
+  release(&lk->lk);
+}
 
+/* Indica si alguien tiene el cerrojo en modo compartido. No se guarda qué procesos son lectores, así que no se puede comprobar que sea el actual. */
+int
+holdingsleep_shared(struct sleeplock *lk)
+{
+  int r;
 
+  acquire(&lk->lk);
+  r = lk->readers > 0;
+  release(&lk->lk);
+  return r;
+}
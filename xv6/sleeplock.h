@@ -2,6 +2,10 @@
 struct sleeplock {
   uint locked;       // Is the lock held?
   struct spinlock lk; // spinlock protecting this sleep lock
+
+  /* Modo compartido (lectores). Los escritores tienen preferencia. */
+  int readers;       // Número de procesos que lo tienen en modo compartido.
+  int wwaiting;      // Número de procesos esperando para tenerlo en exclusiva.
   
   // For debugging:
   char *name;        // Name of lock.
@@ -9,12 +9,33 @@
 #include "proc.h"
 #include "spinlock.h"
 
+extern char end[]; // first address after kernel loaded from ELF file
+
+/* Tabla de cerrojos sobre los que lockstat() informa. */
+static struct {
+  struct spinlock *locks[NLOCKSTAT];
+  volatile uint n;
+} locktab;
+
 void
 initlock(struct spinlock *lk, char *name)
 {
+  uint i;
+
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->nacquire = 0;
+  lk->ncontended = 0;
+  lk->spin = 0;
+
+  /* Sólo se registran los cerrojos de los datos estáticos del kernel. Los que viven en páginas de kalloc() (pipes) pueden liberarse y dejarían punteros colgando en la tabla. */
+  if((char*)lk >= end)
+    return;
+  /* initlock() se llama antes de poder usar acquire(), así que el hueco se reserva con xadd. */
+  if((i = xadd(&locktab.n, 1)) < NLOCKSTAT)
+    locktab.locks[i] = lk;
 }
 
 // Acquire the lock.
@@ -24,19 +45,34 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+  uint64 t0;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // The xadd is atomic: it hands out tickets in FIFO order.
+  ticket = xadd(&lk->next, 1);
+  t0 = 0;
+  if(lk->owner != ticket){
+    t0 = rdtsc();
+    while(lk->owner != ticket)
+      pause();
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
   // references happen after the lock is acquired.
   __sync_synchronize();
 
+  /* Ya tenemos el cerrojo, así que las estadísticas se actualizan sin operaciones atómicas. */
+  lk->nacquire++;
+  if(t0){
+    lk->ncontended++;
+    lk->spin += rdtsc() - t0;
+  }
+
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
@@ -59,10 +95,10 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Release the lock by passing it to the next ticket,
+  // equivalent to lk->owner++. Only the holder writes owner,
+  // so the increment doesn't need a lock prefix.
+  asm volatile("incl %0" : "+m" (lk->owner) : );
 
   popcli();
 }
@@ -91,7 +127,7 @@ holding(struct spinlock *lock)
 {
   int r;
   pushcli();
-  r = lock->locked && lock->cpu == mycpu();
+  r = lock->next != lock->owner && lock->cpu == mycpu();
   popcli();
   return r;
 }
@@ -124,3 +160,88 @@ popcli(void)
     sti();
 }
 
+
+/* Imprime por consola las estadísticas de los cerrojos registrados, agrupando los que comparten nombre (por ejemplo, todos los "buffer"). Se invoca con ^T o con la llamada lockstat(). Sin cerrojos, como procdump(). */
+void
+lockstatdump(void)
+{
+  struct spinlock *lk, *o;
+  uint i, j, n, cnt, acq, cont;
+  uint64 spin;
+
+  n = locktab.n < NLOCKSTAT ? locktab.n : NLOCKSTAT;
+  cprintf("name count acquire contended kcycles\n");
+  for(i = 0; i < n; i++){
+    lk = locktab.locks[i];
+    // Skip names already printed.
+    for(j = 0; j < i; j++)
+      if(strncmp(locktab.locks[j]->name, lk->name, 16) == 0)
+        break;
+    if(j < i)
+      continue;
+    cnt = acq = cont = 0;
+    spin = 0;
+    for(j = i; j < n; j++){
+      o = locktab.locks[j];
+      if(strncmp(o->name, lk->name, 16) != 0)
+        continue;
+      cnt++;
+      acq += o->nacquire;
+      cont += o->ncontended;
+      spin += o->spin;
+    }
+    if(acq == 0)
+      continue;
+    cprintf("%s %d %d %d %d\n", lk->name, cnt, acq, cont, (uint)(spin >> 10));
+  }
+  /* Los que no cupieron en la tabla no aparecen: hay que agrandar NLOCKSTAT. */
+  if(locktab.n > NLOCKSTAT)
+    cprintf("lockstat: %d locks not tracked\n", locktab.n - NLOCKSTAT);
+}
+
+/* Pone a cero las estadísticas de todos los cerrojos registrados. No se toman los cerrojos, así que una adquisición concurrente puede colarse en los contadores. */
+void
+lockstatreset(void)
+{
+  uint i, n;
+  struct spinlock *lk;
+
+  n = locktab.n < NLOCKSTAT ? locktab.n : NLOCKSTAT;
+  for(i = 0; i < n; i++){
+    lk = locktab.locks[i];
+    lk->nacquire = 0;
+    lk->ncontended = 0;
+    lk->spin = 0;
+  }
+}
+
+/* Microbenchmark de cerrojos sin contención. Deja en res[0] los ciclos medios de una pareja acquire()/release(), en res[1] los de mycpu() y en res[2] los de findcpu(), la búsqueda por LAPIC id que hacía mycpu() antes de usar %gs. */
+void
+lockbench(int n, uint *res)
+{
+  struct spinlock lk;
+  uint64 t0;
+  int i;
+
+  initlock(&lk, "lockbench");
+  pushcli();
+
+  t0 = rdtsc();
+  for(i = 0; i < n; i++){
+    acquire(&lk);
+    release(&lk);
+  }
+  res[0] = (uint)(rdtsc() - t0) / n;
+
+  t0 = rdtsc();
+  for(i = 0; i < n; i++)
+    mycpu();
+  res[1] = (uint)(rdtsc() - t0) / n;
+
+  t0 = rdtsc();
+  for(i = 0; i < n; i++)
+    findcpu();
+  res[2] = (uint)(rdtsc() - t0) / n;
+
+  popcli();
+}
@@ -1,11 +1,18 @@
 // Mutual exclusion lock.
+// Ticket lock: each acquire() takes a ticket from next and waits
+// until owner reaches it, so CPUs are served in FIFO order.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  volatile uint next;  // Next ticket to hand out.
+  volatile uint owner; // Ticket currently holding the lock.
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
-};
 
+  /* Estadísticas de contención (ver lockstat()). Sólo las modifica quien tiene el cerrojo. */
+  uint nacquire;     // Número de adquisiciones.
+  uint ncontended;   // Adquisiciones que tuvieron que esperar.
+  uint64 spin;       // Ciclos (rdtsc) gastados esperando.
+};
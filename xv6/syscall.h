@@ -29,4 +29,27 @@
 
 /* --- Boletín 3. Ejercicio 2. --- */
 #define SYS_getprio  24
-#define SYS_setprio  25 
\ No newline at end of file
+#define SYS_setprio  25
+
+#define SYS_lockstat 26
+#define SYS_lockbench 27
+#define SYS_iostat   28
+#define SYS_fcntl    29
+#define SYS_splice   30
+#define SYS_readv    31
+#define SYS_writev   32
+#define SYS_pread    33
+#define SYS_pwrite   34
+#define SYS_lseek    35
+#define SYS_mmap     36
+#define SYS_munmap   37
+#define SYS_msync    38
+#define SYS_shmget   39
+#define SYS_shmat    40
+#define SYS_shmdt    41
+#define SYS_shmctl   42
+#define SYS_clone    43
+#define SYS_join     44
+#define SYS_futex_wait 45
+#define SYS_futex_wake 46
+#define SYS_poll     47
@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "iostat.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -133,11 +134,99 @@ sys_write(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, (void**)&p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argbuf(1, (void**)&p, n) < 0)
     return -1;
   return filewrite(f, p, n);
 }
 
+// Fetch the iovec array of readv()/writev() from arguments n and
+// n+1 into iov, checking that the buffers lie in user memory and,
+// for readv() (write != 0), that the kernel may write to them.
+static int
+argiov(int n, struct iovec *iov, int *pcnt, int write)
+{
+  struct iovec *uiov;
+  int cnt, i;
+  uint tot;
+
+  if(argint(n+1, &cnt) < 0 || cnt < 0 || cnt > NIOV)
+    return -1;
+  if(argbuf(n, (void**)&uiov, cnt*sizeof(*uiov)) < 0)
+    return -1;
+  tot = 0;
+  for(i = 0; i < cnt; i++){
+    iov[i] = uiov[i];
+    if(iov[i].iov_len < 0 || uvmcheck((uint)iov[i].iov_base, iov[i].iov_len, write) < 0)
+      return -1;
+    // The buffers may overlap: bound the total, which is an int.
+    if((tot += iov[i].iov_len) > IOVMAX)
+      return -1;
+  }
+  *pcnt = cnt;
+  return 0;
+}
+
+int
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[NIOV];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt, 1) < 0)
+    return -1;
+  return filereadv(f, iov, cnt, 0);
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[NIOV];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt, 0) < 0)
+    return -1;
+  return filewritev(f, iov, cnt, 0);
+}
+
+int
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int off;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &iov.iov_len) < 0 ||
+     argptr(1, &iov.iov_base, iov.iov_len) < 0 || argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filereadv(f, &iov, 1, (uint*)&off);
+}
+
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int off;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &iov.iov_len) < 0 ||
+     argbuf(1, &iov.iov_base, iov.iov_len) < 0 || argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filewritev(f, &iov, 1, (uint*)&off);
+}
+
+int
+sys_lseek(void)
+{
+  struct file *f;
+  int off, whence;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &off) < 0 || argint(2, &whence) < 0)
+    return -1;
+  return fileseek(f, off, whence);
+}
+
 int
 sys_close(void)
 {
@@ -233,7 +322,6 @@ int
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ], *path;
   uint off;
 
@@ -263,8 +351,7 @@ sys_unlink(void)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+  if(dirunlink(dp, name, off) < 0)
     panic("unlink: writei");
   if(ip->type == T_DIR){
     dp->nlink--;
@@ -323,8 +410,18 @@ create(char *path, short type, short major, short minor)
       panic("create dots");
   }
 
-  if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+  if(dirlink(dp, name, ip->inum) < 0){
+    // No room in dp's index: undo the new inode.
+    if(type == T_DIR){
+      dp->nlink--;
+      iupdate(dp);
+    }
+    ip->nlink = 0;
+    iupdate(ip);
+    iunlockput(ip);
+    iunlockput(dp);
+    return 0;
+  }
 
   iunlockput(dp);
 
@@ -491,3 +588,108 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+/* Copia al usuario las estadísticas de la caché de bloques. */
+int
+sys_iostat(void)
+{
+  struct iostat *st;
+
+  if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  bstat(st);
+  idestat(st);
+  logstat(st);
+  fsstat(st);
+  procstat(st);
+  return 0;
+}
+
+// Control an open file. Only pipes have anything to set: the size
+// of their buffer.
+int
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+  if(f->type != FD_PIPE)
+    return -1;
+  switch(cmd){
+  case F_GETPIPE_SZ:
+    return pipegetsize(f->pipe);
+  case F_SETPIPE_SZ:
+    return pipesetsize(f->pipe, arg);
+  }
+  return -1;
+}
+
+// Move up to n bytes between a file and a pipe without copying
+// them through user space. One of fd_in and fd_out must be a pipe
+// and the other a file. Returns the number of bytes moved.
+int
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  if(n < 0)
+    return -1;
+  if(in->type == FD_INODE && out->type == FD_PIPE && out->writable)
+    return pipefill(out->pipe, in, n);
+  if(in->type == FD_PIPE && in->readable && out->type == FD_INODE)
+    return pipedrain(in->pipe, out, n);
+  return -1;
+}
+
+int
+sys_mmap(void)
+{
+  struct file *f;
+  int len, prot, flags, fd, off;
+
+  // The address, argument 0, is only a hint: mmap() picks its own.
+  if(argint(1, &len) < 0 || argint(2, &prot) < 0 || argint(3, &flags) < 0 ||
+     argint(4, &fd) < 0 || argint(5, &off) < 0 || len <= 0 || off < 0)
+    return -1;
+  f = 0;
+  if(!(flags & MAP_ANON) && argfd(4, 0, &f) < 0)
+    return -1;
+  return mmap(len, prot, flags, f, off);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || len <= 0)
+    return -1;
+  return munmap(addr, len);
+}
+
+int
+sys_msync(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || len < 0)
+    return -1;
+  return msync(addr, len);
+}
+
+int
+sys_poll(void)
+{
+  struct pollfd *fds;
+  int nfds, timeout;
+
+  if(argint(1, &nfds) < 0 || argint(2, &timeout) < 0 || nfds < 0 ||
+     argptr(0, (void*)&fds, nfds*sizeof(*fds)) < 0)
+    return -1;
+  return poll(fds, nfds, timeout);
+}
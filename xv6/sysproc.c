@@ -65,31 +65,15 @@ sys_getpid(void)
 int
 sys_sbrk(void)
 {
-  int addr;
   int n;
 
   if(argint(0, &n) < 0)
     return -1;
 
-  /* Guardamos el tamaño antiguo. */ 
-  addr = myproc()->sz;
-  
-  /* Si no se pide decrementar la memoria simplemente aumentamos la memoria del proceso. */
-  if (n >= 0)
-  {
-    /* Si la memoria pedida llega hasta el kernel se debe fallar. */
-    if (myproc()->sz + n >= KERNBASE)
-      return -1;
-    myproc()->sz += n;
-  }
-  
+  /* Si no se pide decrementar la memoria growproc(n) simplemente aumenta el tamaño del proceso, y falla si llega hasta el kernel o hasta las proyecciones de mmap(). */
   /* --- Boletín 2. Ejercicio 2. --- */
-  /* Si se decrementa la memoria llamamos a growproc(n). No hay que decrementar manualmente el tamaño, ya lo hace growproc().*/
-  else if(growproc(n) < 0)
-    return -1;
-  
-  /* Se devuelve el tamaño antíguo de la memoria. */
-  return addr;
+  /* Si se decrementa la memoria growproc(n) libera las páginas. Lo hace todo con los cerrojos del espacio de direcciones, que pueden compartir varios hilos, y devuelve el tamaño antiguo de la memoria. */
+  return growproc(n);
 }
 
 int
@@ -173,4 +157,148 @@ sys_setprio(void)
     return -1;
 
   return setprio(pid, prio);
-}
\ No newline at end of file
+}
+
+/* Vuelca por consola las estadísticas de los cerrojos. Si reset no es 0 las pone después a cero. */
+int
+sys_lockstat(void)
+{
+  int reset;
+
+  if (argint(0, &reset) < 0)
+    return -1;
+
+  lockstatdump();
+  if (reset)
+    lockstatreset();
+
+  return 0;
+}
+
+/* Mide el coste de los cerrojos sin contención (ver lockbench()). Deja tres contadores de ciclos en el vector del usuario. */
+int
+sys_lockbench(void)
+{
+  int n;
+  uint *res;
+
+  if (argint(0, &n) < 0)
+    return -1;
+
+  if (argptr(1, (void *)&res, 3 * sizeof(uint)) < 0)
+    return -1;
+
+  /* Se limita n para que el total de ciclos quepa en 32 bits. */
+  if (n <= 0 || n > 1000000)
+    return -1;
+
+  lockbench(n, res);
+
+  return 0;
+}
+
+/* Segmentos de memoria compartida (ver shm.c). */
+int
+sys_shmget(void)
+{
+  int key, size, flags;
+
+  if (argint(0, &key) < 0 || argint(1, &size) < 0 || argint(2, &flags) < 0)
+    return -1;
+
+  if (size < 0)
+    return -1;
+
+  return shmget(key, size, flags);
+}
+
+int
+sys_shmat(void)
+{
+  int id;
+
+  if (argint(0, &id) < 0)
+    return -1;
+
+  return shmat(id);
+}
+
+int
+sys_shmdt(void)
+{
+  int addr;
+
+  if (argint(0, &addr) < 0)
+    return -1;
+
+  return shmdt(addr);
+}
+
+int
+sys_shmctl(void)
+{
+  int id, cmd;
+
+  if (argint(0, &id) < 0 || argint(1, &cmd) < 0)
+    return -1;
+
+  return shmctl(id, cmd);
+}
+
+/* Crea un hilo que ejecuta fn(arg) sobre la pila [stack, stack+size) y comparte la memoria del proceso (ver clone()). */
+int
+sys_clone(void)
+{
+  int fn, arg, size;
+  char *stack;
+
+  if (argint(0, &fn) < 0 || argint(1, &arg) < 0 || argint(3, &size) < 0)
+    return -1;
+
+  /* La pila debe dejar sitio al argumento y a la dirección de retorno. */
+  if (size < 64 || argptr(2, (void *)&stack, size) < 0)
+    return -1;
+
+  return clone(fn, arg, (uint)stack, size);
+}
+
+/* Espera a que acabe un hilo creado con clone() y deja en *stack la pila que se le dio. */
+int
+sys_join(void)
+{
+  int tid, pid;
+  uint stack, *ustack;
+
+  if (argint(0, &tid) < 0 || argptr(1, (void *)&ustack, sizeof(*ustack)) < 0)
+    return -1;
+
+  if ((pid = join(tid, &stack)) < 0)
+    return -1;
+
+  *ustack = stack;
+  return pid;
+}
+
+/* Duerme mientras la palabra en addr valga val, hasta un futex_wake() sobre ella (ver futex.c). */
+int
+sys_futex_wait(void)
+{
+  int addr, val;
+
+  if (argint(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+
+  return futexwait(addr, val);
+}
+
+/* Despierta hasta n procesos dormidos en la palabra en addr. Devuelve cuántos. */
+int
+sys_futex_wake(void)
+{
+  int addr, n;
+
+  if (argint(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+
+  return futexwake(addr, n);
+}
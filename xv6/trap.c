@@ -7,6 +7,8 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
@@ -72,9 +74,14 @@ trap(struct trapframe *tf)
       ticks++;
       wakeup(&ticks);
       release(&tickslock);
+      polltick();
     }
     lapiceoi();
     break;
+  case T_TLBFLUSH:
+    tlbintr();
+    lapiceoi();
+    break;
   case T_IRQ0 + IRQ_IDE:
     ideintr();
     lapiceoi();
@@ -102,10 +109,17 @@ trap(struct trapframe *tf)
   case T_PGFLT:
 
     uint fltaddr = rcr2();
+    struct mm *mm = myproc()->mm;
+
+    /* Los hilos del proceso comparten la tabla de páginas: sz y los cambios en la tabla se protegen con el cerrojo de su espacio de direcciones. */
+    acquire(&mm->lock);
 
-    /* Si la dirección de fallo de página está por encima del tamaño de la memoria es un fallo catastrófico. Hay que matar el proceso. */
-    if (fltaddr >= myproc()->sz)
+    /* Si la dirección de fallo de página está por encima del tamaño de la memoria es un fallo catastrófico, salvo que caiga en una proyección de mmap(): vmafault() trae la página. Hay que matar el proceso. */
+    if (fltaddr >= mm->sz)
     {
+      release(&mm->lock);
+      if (fltaddr < KERNBASE && vmafault(fltaddr, tf->err & PTE_W) == 0)
+        break;
       if (fltaddr >= KERNBASE)
         cprintf("Page fault on addr: 0x%x outside user space memory\n", fltaddr);
       else
@@ -117,11 +131,27 @@ trap(struct trapframe *tf)
     /* --- Boletín 2. Ejercicio 2. --- */
     /* su entrada en la tabla de páginas. */
     uint fltpage = PGROUNDDOWN(fltaddr);
+
+    /* Escritura en una página copy-on-write, compartida con una tubería (ver cowfault()). Puede venir también del kernel, al copiar a un buffer de usuario. */
+    if ((tf->err & PTE_W) && cowfault(myproc()->pgdir, fltpage) == 0)
+    {
+      release(&mm->lock);
+      break;
+    }
     pde_t * pgfltpde = walkpgdir(myproc()->pgdir, (void *)fltpage, 0);
  
     /* Comprobamos si la página estaba reservada y en ese caso sí estaba presente. */
     if (pgfltpde && *pgfltpde & PTE_P)
     {
+      /* Otro hilo puede haber traído ya la página, o resuelto la copia en escritura, con una entrada antigua en el TLB de esta CPU. Si la página ya permite el acceso basta con vaciar el TLB. */
+      if ((*pgfltpde & PTE_U) && (!(tf->err & PTE_W) || (*pgfltpde & PTE_W)))
+      {
+        lcr3(V2P(myproc()->pgdir));
+        release(&mm->lock);
+        break;
+      }
+      release(&mm->lock);
+
       /* Si el bit de user no está activado en error el fallo es del kernel sobre una página presente y el sistema no puede seguir. */
       if (!(tf->err & PTE_U))
         panic("kernel had a page fault");
@@ -146,6 +176,7 @@ trap(struct trapframe *tf)
     char *mem;
     if ((mem = kalloc()) == 0)
     {
+      release(&mm->lock);
       cprintf("error by kalloc on page fault. out of memory\n");
       myproc()->killed = 1;
       break;
@@ -158,6 +189,7 @@ trap(struct trapframe *tf)
       cprintf("error by mappages on page fault, cant cant map physical page on page table\n");
       myproc()->killed = 1;
     }
+    release(&mm->lock);
 
     break;
 
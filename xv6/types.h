@@ -8,6 +8,7 @@ typedef unsigned int   uint;
 typedef unsigned short ushort;
 typedef unsigned char  uchar;
 typedef uint pde_t;
+typedef unsigned long long uint64;
 
 #ifndef NULL
 #define NULL 0
@@ -1,16 +1,50 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "fcntl.h"
+
+#define CHUNK (64*1024)  // bytes mapped at a time
 
 char buf[512];
 
+// Write a regular file out of a read-only shared mmap() of it, a
+// chunk at a time: write() takes the data straight from the
+// buffer cache pages, with no read() copy. Returns -1 if fp is
+// not a regular file that can be mapped, or is stdin, which need
+// not be at the start of its file.
+int
+catmap(FILE *fp)
+{
+  struct stat st;
+  char *p;
+  int n, off;
+
+  if(fp == stdin || fstat(fileno(fp), &st) < 0 || st.type != T_FILE || st.size == 0)
+    return -1;
+  if((p = mmap(0, st.size, PROT_READ, MAP_SHARED, fileno(fp), 0)) == MAP_FAILED)
+    return -1;
+  fflush(stdout);
+  for(off = 0; off < st.size; off += n){
+    n = st.size - off < CHUNK ? st.size - off : CHUNK;
+    if(write(1, p + off, n) != n){
+      printf(1, "cat: write error\n");
+      exit(EXIT_FAILURE);
+    }
+    munmap(p + off, n);
+  }
+  return 0;
+}
+
 void
-cat(int fd)
+cat(FILE *fp)
 {
   int n;
 
-  while((n = read(fd, buf, sizeof(buf))) > 0) {
-    if (write(1, buf, n) != n) {
+  if(catmap(fp) == 0)
+    return;
+
+  while((n = fread(buf, sizeof(buf), fp)) > 0) {
+    if (fwrite(buf, n, stdout) != n) {
       printf(1, "cat: write error\n");
       exit(EXIT_FAILURE);
     }
@@ -24,20 +58,21 @@ cat(int fd)
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  FILE *fp;
+  int i;
 
   if(argc <= 1){
-    cat(0);
+    cat(stdin);
     exit(EXIT_SUCCESS);
   }
 
   for(i = 1; i < argc; i++){
-    if((fd = open(argv[i], 0)) < 0){
+    if((fp = fopen(argv[i], 0)) == 0){
       printf(1, "cat: cannot open %s\n", argv[i]);
       exit(EXIT_FAILURE);
     }
-    cat(fd);
-    close(fd);
+    cat(fp);
+    fclose(fp);
   }
   exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,69 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+/* Benchmark de lectores concurrentes: nproc procesos leen el mismo fichero (README por defecto) rounds veces, como varios cat a la vez. Se mide con uptime() el tiempo total para 1 lector y para nproc lectores. Con ilock_shared() los lectores no se esperan entre sí en el inodo. */
+
+char buf[512];
+
+static int
+readall(char *path, int rounds)
+{
+  int fd, n, i, total;
+
+  total = 0;
+  for(i = 0; i < rounds; i++){
+    if((fd = open(path, O_RDONLY)) < 0){
+      printf(2, "catbench: cannot open %s\n", path);
+      exit(EXIT_FAILURE);
+    }
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+      total += n;
+    close(fd);
+  }
+  return total;
+}
+
+static void
+run(char *path, int nproc, int rounds)
+{
+  int i, start, ticks, bytes;
+
+  start = uptime();
+  for(i = 0; i < nproc; i++){
+    if(fork() == 0){
+      readall(path, rounds);
+      exit(EXIT_SUCCESS);
+    }
+  }
+  for(i = 0; i < nproc; i++)
+    wait(NULL);
+  ticks = uptime() - start;
+
+  bytes = readall(path, 1) * nproc * rounds;
+  printf(1, "%d readers: %d bytes in %d ticks\n", nproc, bytes, ticks);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *path = "README";
+  int nproc = 4, rounds = 50;
+
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(argc > 2)
+    rounds = atoi(argv[2]);
+  if(argc > 3)
+    path = argv[3];
+
+  if(nproc < 1 || rounds < 1){
+    printf(2, "usage: catbench [nproc] [rounds] [file]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  run(path, 1, rounds);
+  run(path, nproc, rounds);
+  exit(EXIT_SUCCESS);
+}
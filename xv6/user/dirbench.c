@@ -0,0 +1,76 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+/* Benchmark de directorios grandes: crea n nombres en un directorio nuevo (enlaces a un mismo fichero, para no gastar inodos), los busca todos y los borra, y da los ticks de cada fase. Con directorios lineales cada fase es O(n²); con índice, cada nombre cuesta lo mismo tenga el directorio el tamaño que tenga. */
+
+char name[32];
+
+static char*
+mkname(int i)
+{
+  char *p;
+
+  strcpy(name, "dirbench/entry_");
+  p = name + strlen(name);
+  *p++ = '0' + i / 1000 % 10;
+  *p++ = '0' + i / 100 % 10;
+  *p++ = '0' + i / 10 % 10;
+  *p++ = '0' + i % 10;
+  *p = 0;
+  return name;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n = 1000, i, fd, t0, t1, t2, t3;
+  struct stat st;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1 || n > 9999){
+    printf(2, "usage: dirbench [names <= 9999]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if(mkdir("dirbench") < 0){
+    printf(2, "dirbench: cannot create dirbench\n");
+    exit(EXIT_FAILURE);
+  }
+  if((fd = open("dirbench.f", O_CREATE | O_RDWR)) < 0){
+    printf(2, "dirbench: cannot create dirbench.f\n");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if(link("dirbench.f", mkname(i)) < 0){
+      printf(2, "dirbench: link %s failed\n", name);
+      exit(EXIT_FAILURE);
+    }
+  }
+  t1 = uptime();
+  for(i = 0; i < n; i++){
+    if(stat(mkname(i), &st) < 0){
+      printf(2, "dirbench: stat %s failed\n", name);
+      exit(EXIT_FAILURE);
+    }
+  }
+  t2 = uptime();
+  for(i = 0; i < n; i++){
+    if(unlink(mkname(i)) < 0){
+      printf(2, "dirbench: unlink %s failed\n", name);
+      exit(EXIT_FAILURE);
+    }
+  }
+  t3 = uptime();
+  unlink("dirbench");
+  unlink("dirbench.f");
+
+  printf(1, "%d names: link %d ticks, stat %d ticks, unlink %d ticks\n",
+         n, t1 - t0, t2 - t1, t3 - t2);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,133 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "iostat.h"
+
+/* Benchmark de escritura a disco al estilo de stressfs: escribe kb KB en write() de chunk KB sobre un fichero de 64KB (reescribiéndolo por vueltas) y cuenta con iostat() los bloques que llegan al disco y las transacciones del log. El coste de CPU se estima con un proceso que gira durante una ventana de ticks: lo que gira menos con E/S que en vacío es tiempo de CPU consumido por la E/S. Tiene sentido con CPUS=1. */
+
+#define FILEKB 64
+
+char buf[FILEKB*1024];
+
+/* Lanza un proceso que gira durante ticks ticks; devuelve el descriptor por el que enviará sus vueltas. */
+static int
+spinner(int ticks)
+{
+  int p[2], pid, end;
+  volatile int i;
+  uint n;
+
+  if(pipe(p) < 0){
+    printf(2, "diskbench: pipe failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if((pid = fork()) < 0){
+    printf(2, "diskbench: fork failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if(pid == 0){
+    close(p[0]);
+    n = 0;
+    end = uptime() + ticks;
+    while(uptime() < end){
+      for(i = 0; i < 10000; i++)
+        ;
+      n++;
+    }
+    write(p[1], &n, sizeof(n));
+    exit(EXIT_SUCCESS);
+  }
+  close(p[1]);
+  return p[0];
+}
+
+static uint
+spincount(int fd)
+{
+  uint n = 0;
+
+  read(fd, &n, sizeof(n));
+  close(fd);
+  wait(NULL);
+  return n;
+}
+
+static void
+writeall(char *path, int kb, int chunk)
+{
+  int fd, done, i;
+
+  fd = -1;
+  for(done = 0; done < kb; done += chunk/1024){
+    if(done % FILEKB == 0){
+      if(fd >= 0)
+        close(fd);
+      if((fd = open(path, O_CREATE | O_RDWR)) < 0){
+        printf(2, "diskbench: cannot create %s\n", path);
+        exit(EXIT_FAILURE);
+      }
+    }
+    for(i = 0; i < chunk; i++)
+      buf[i] = 'a' + done % 26;
+    if(write(fd, buf, chunk) != chunk){
+      printf(2, "diskbench: write failed\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *path = "diskbench.tmp";
+  int kb = 1024, window = 500, chunk = 4;
+  int fd, start, ticks, busy, blocks;
+  uint idle, spun;
+  struct iostat st0, st1;
+
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(argc > 2)
+    window = atoi(argv[2]);
+  if(argc > 3)
+    chunk = atoi(argv[3]);
+  if(chunk < 1 || chunk > FILEKB || FILEKB % chunk != 0 || kb < chunk || window < 1){
+    printf(2, "usage: diskbench [kb] [window ticks] [chunk kb, divides %d]\n", FILEKB);
+    exit(EXIT_FAILURE);
+  }
+  chunk *= 1024;
+
+  /* Referencia: vueltas del spinner con la CPU libre. */
+  idle = spincount(spinner(window)) / window;
+  if(idle == 0)
+    idle = 1;
+
+  fd = spinner(window);
+  iostat(&st0);
+  start = uptime();
+  writeall(path, kb, chunk);
+  ticks = uptime() - start;
+  iostat(&st1);
+  spun = spincount(fd);
+  unlink(path);
+
+  if(ticks > window)
+    printf(2, "diskbench: i/o took %d ticks, longer than the %d tick window\n",
+           ticks, window);
+  if(ticks == 0)
+    ticks = 1;
+  busy = window - spun / idle;
+  if(busy < 0)
+    busy = 0;
+  blocks = (st1.ndiskread - st0.ndiskread) + (st1.ndiskwrite - st0.ndiskwrite);
+
+  printf(1, "%s: %d KB in %d ticks, %d disk blocks (%d blocks/tick)\n",
+         st1.dma ? "dma" : "pio", kb, ticks, blocks, blocks / ticks);
+  printf(1, "cpu: %d of %d ticks busy, %d ticks per MB\n",
+         busy, window, busy * 1024 / kb);
+  printf(1, "log: %d commits, %d blocks logged\n",
+         st1.ncommit - st0.ncommit, st1.nlogged - st0.nlogged);
+  exit(EXIT_SUCCESS);
+}
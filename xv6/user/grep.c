@@ -8,29 +8,16 @@ char buf[1024];
 int match(char*, char*);
 
 void
-grep(char *pattern, int fd)
+grep(char *pattern, FILE *fp)
 {
-  int n, m;
-  char *p, *q;
+  char *q;
 
-  m = 0;
-  while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
-    m += n;
-    buf[m] = '\0';
-    p = buf;
-    while((q = strchr(p, '\n')) != 0){
+  while(fgets(buf, sizeof(buf), fp) != 0){
+    if((q = strchr(buf, '\n')) != 0)
       *q = 0;
-      if(match(pattern, p)){
-        *q = '\n';
-        write(1, p, q+1 - p);
-      }
-      p = q+1;
-    }
-    if(p == buf)
-      m = 0;
-    if(m > 0){
-      m -= p - buf;
-      memmove(buf, p, m);
+    if(match(pattern, buf)){
+      fputs(buf, stdout);
+      fputc('\n', stdout);
     }
   }
 }
@@ -38,7 +25,8 @@ grep(char *pattern, int fd)
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  FILE *fp;
+  int i;
   char *pattern;
 
   if(argc <= 1){
@@ -48,17 +36,17 @@ main(int argc, char *argv[])
   pattern = argv[1];
 
   if(argc <= 2){
-    grep(pattern, 0);
+    grep(pattern, stdin);
     exit(EXIT_SUCCESS);
   }
 
   for(i = 2; i < argc; i++){
-    if((fd = open(argv[i], 0)) < 0){
+    if((fp = fopen(argv[i], 0)) == 0){
       printf(1, "grep: cannot open %s\n", argv[i]);
       exit(EXIT_FAILURE);
     }
-    grep(pattern, fd);
-    close(fd);
+    grep(pattern, fp);
+    fclose(fp);
   }
   exit(EXIT_SUCCESS);
 }
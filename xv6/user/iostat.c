@@ -0,0 +1,32 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "iostat.h"
+
+/* Muestra las estadísticas de E/S de bloques del kernel. */
+int
+main(int argc, char *argv[])
+{
+  struct iostat st;
+  uint n;
+
+  if(iostat(&st) < 0){
+    printf(2, "iostat: failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  printf(1, "bcache: %d buffers, %d hits, %d misses, %d evictions\n",
+         st.nbuf, st.bhits, st.bmisses, st.bevictions);
+  printf(1, "readahead: %d blocks\n", st.nreadahead);
+  printf(1, "disk: %s, %d blocks read, %d blocks written\n",
+         st.dma ? "dma" : "pio", st.ndiskread, st.ndiskwrite);
+  printf(1, "log: %d blocks, %d commits, %d blocks logged\n",
+         st.nlog, st.ncommit, st.nlogged);
+  printf(1, "icache: %d hits, %d misses; name cache: %d hits, %d misses\n",
+         st.ihits, st.imisses, st.dhits, st.dmisses);
+  n = st.ndiskread + st.ndiskwrite;
+  if(n > 0)
+    printf(1, "disk: %d commands, %d kcycles queued and %d in service per block\n",
+           st.ndiskcmd, st.qwait / n, st.service / n);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,111 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "iostat.h"
+
+/* Benchmark de llamadas al sistema: escribe n registros de cuatro trozos (como una línea de ls) con un write() por trozo y con un writev() por registro, y los relee con lseek()+read() y con pread(). Da, para cada forma, las llamadas al sistema (contadas por iostat()) y los ticks. */
+
+#define NPIECE 4
+
+char *piece[NPIECE] = { "name          ", "2 ", "17 ", "4096\n" };
+char rec[64];
+
+static int t0;
+static uint sc0;
+
+static void
+begin(void)
+{
+  struct iostat st;
+
+  iostat(&st);
+  sc0 = st.nsyscall;
+  t0 = uptime();
+}
+
+static void
+end(char *what, int n)
+{
+  struct iostat st;
+  int ticks;
+
+  ticks = uptime() - t0;
+  iostat(&st);
+  /* La llamada a iostat() de begin() ya está contada. */
+  printf(1, "%s: %d records, %d syscalls, %d ticks\n", what, n, st.nsyscall - sc0 - 1, ticks);
+}
+
+static int
+create(char *path)
+{
+  int fd;
+
+  if((fd = open(path, O_CREATE | O_RDWR)) < 0){
+    printf(2, "iovbench: cannot create %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  return fd;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct iovec iov[NPIECE];
+  int n = 2000, fd, i, j, len;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1){
+    printf(2, "usage: iovbench [records]\n");
+    exit(EXIT_FAILURE);
+  }
+  len = 0;
+  for(j = 0; j < NPIECE; j++){
+    iov[j].iov_base = piece[j];
+    iov[j].iov_len = strlen(piece[j]);
+    len += iov[j].iov_len;
+  }
+
+  fd = create("iovbench.1");
+  begin();
+  for(i = 0; i < n; i++)
+    for(j = 0; j < NPIECE; j++)
+      write(fd, piece[j], iov[j].iov_len);
+  end("write", n);
+  close(fd);
+
+  fd = create("iovbench.2");
+  begin();
+  for(i = 0; i < n; i++)
+    if(writev(fd, iov, NPIECE) != len){
+      printf(2, "iovbench: writev failed\n");
+      exit(EXIT_FAILURE);
+    }
+  end("writev", n);
+
+  /* Relee los registros en orden inverso, como haría un índice. */
+  begin();
+  for(i = n - 1; i >= 0; i--){
+    lseek(fd, i * len, SEEK_SET);
+    if(read(fd, rec, len) != len){
+      printf(2, "iovbench: read failed\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  end("lseek+read", n);
+
+  begin();
+  for(i = n - 1; i >= 0; i--){
+    if(pread(fd, rec, len, i * len) != len){
+      printf(2, "iovbench: pread failed\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  end("pread", n);
+  close(fd);
+
+  unlink("iovbench.1");
+  unlink("iovbench.2");
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,25 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+/* Mide en el kernel el coste de una pareja acquire()/release() sin contención y el de localizar la cpu actual. La búsqueda por LAPIC id es lo que costaba mycpu() antes de usar %gs, así que sirve de referencia. */
+int
+main(int argc, char *argv[])
+{
+  int n = 100000;
+  uint res[3];
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+
+  if(lockbench(n, res) < 0){
+    printf(2, "usage: lockbench [iterations <= 1000000]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  printf(1, "lockbench: %d iterations\n", n);
+  printf(1, "acquire/release: %d cycles\n", res[0]);
+  printf(1, "mycpu() via %%gs: %d cycles\n", res[1]);
+  printf(1, "lapic id scan: %d cycles\n", res[2]);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,24 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+/* Muestra por consola las estadísticas de los cerrojos del kernel. Con -r las pone a cero tras mostrarlas. */
+int
+main(int argc, char *argv[])
+{
+  int reset = 0;
+
+  if(argc > 1){
+    if(strcmp(argv[1], "-r") != 0){
+      printf(2, "usage: lockstat [-r]\n");
+      exit(EXIT_FAILURE);
+    }
+    reset = 1;
+  }
+
+  if(lockstat(reset) < 0){
+    printf(2, "lockstat: failed\n");
+    exit(EXIT_FAILURE);
+  }
+  exit(EXIT_SUCCESS);
+}
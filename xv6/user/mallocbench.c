@@ -0,0 +1,114 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "iostat.h"
+
+/* Benchmark de malloc(): reserva n bloques y los libera en orden inverso (lifo), en el mismo orden (fifo) y al azar sobre NSLOT huecos (random, con la heap máxima medida al final), con tamaños pequeños o hasta max bytes. Da, para cada prueba, las llamadas al sistema (los sbrk() del asignador), los ticks y lo que ha crecido la heap, antes y después de liberarlo todo. */
+
+#define NSLOT 1000
+
+char *slot[NSLOT];
+char **blk;
+uint randstate = 1;
+
+static int t0;
+static uint sc0;
+static char *brk0;
+
+static uint
+rand(void)
+{
+  randstate = randstate * 1664525 + 1013904223;
+  return randstate >> 8;
+}
+
+static void
+begin(void)
+{
+  struct iostat st;
+
+  iostat(&st);
+  sc0 = st.nsyscall;
+  brk0 = sbrk(0);
+  t0 = uptime();
+}
+
+static void
+end(char *what, int ops, int peak)
+{
+  struct iostat st;
+  int ticks;
+
+  ticks = uptime() - t0;
+  iostat(&st);
+  /* Las llamadas a iostat() y sbrk() de begin() ya están contadas. */
+  printf(1, "%s: %d ops, %d syscalls, %d ticks, heap +%d KB peak, +%d KB after free\n",
+         what, ops, st.nsyscall - sc0 - 2, ticks, peak / 1024, (sbrk(0) - brk0) / 1024);
+}
+
+static char*
+alloc(int max)
+{
+  char *p;
+  int n;
+
+  n = 1 + rand() % max;
+  if((p = malloc(n)) == 0){
+    printf(2, "mallocbench: out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  p[0] = p[n-1] = 1;
+  return p;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n = 10000, max = 128, i, peak;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(argc > 2)
+    max = atoi(argv[2]);
+  if(n < 1 || max < 1){
+    printf(2, "usage: mallocbench [blocks] [max size]\n");
+    exit(EXIT_FAILURE);
+  }
+  if((blk = malloc(n * sizeof(blk[0]))) == 0){
+    printf(2, "mallocbench: out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  begin();
+  for(i = 0; i < n; i++)
+    blk[i] = alloc(max);
+  peak = sbrk(0) - brk0;
+  for(i = n - 1; i >= 0; i--)
+    free(blk[i]);
+  end("lifo", 2 * n, peak);
+
+  begin();
+  for(i = 0; i < n; i++)
+    blk[i] = alloc(max);
+  peak = sbrk(0) - brk0;
+  for(i = 0; i < n; i++)
+    free(blk[i]);
+  end("fifo", 2 * n, peak);
+
+  begin();
+  for(i = 0; i < 2 * n; i++){
+    /* Un hueco ocupado se libera y, la mitad de las veces, se vuelve a llenar. */
+    if(slot[i % NSLOT]){
+      free(slot[i % NSLOT]);
+      slot[i % NSLOT] = 0;
+      if(rand() % 2)
+        continue;
+    }
+    slot[i % NSLOT] = alloc(max);
+  }
+  peak = sbrk(0) - brk0;
+  for(i = 0; i < NSLOT; i++)
+    free(slot[i]);
+  end("random", 2 * n, peak);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,111 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+/* Mezcla las líneas de n pipes según van llegando: n hijos escriben lines líneas cada uno, el hijo i con una pausa de i+1 ticks entre ellas, y el padre espera con poll() a que cualquiera de los pipes tenga datos en vez de bloquearse leyendo uno. Cada línea sale entera aunque llegue en varios trozos: se guarda lo leído de cada pipe hasta el salto de línea. */
+
+#define MAXIN   8
+#define LINELEN 128
+
+char line[MAXIN][LINELEN];
+int len[MAXIN];
+
+static void
+writer(int fd, int i, int lines)
+{
+  char buf[LINELEN];
+  int j, k;
+
+  for(j = 0; j < lines; j++){
+    sleep(i + 1);
+    strcpy(buf, "pipe ");
+    k = strlen(buf);
+    buf[k++] = '0' + i;
+    strcpy(buf + k, ": line ");
+    k = strlen(buf);
+    if(j >= 10)
+      buf[k++] = '0' + j / 10 % 10;
+    buf[k++] = '0' + j % 10;
+    buf[k++] = '\n';
+    if(write(fd, buf, k) != k)
+      exit(EXIT_FAILURE);
+  }
+  exit(EXIT_SUCCESS);
+}
+
+/* Añade n bytes leídos del pipe i y escribe las líneas que quedan completas. */
+static void
+add(int i, char *buf, int n)
+{
+  int k;
+
+  for(k = 0; k < n; k++){
+    if(len[i] < LINELEN)
+      line[i][len[i]++] = buf[k];
+    if(buf[k] == '\n' || len[i] == LINELEN){
+      write(1, line[i], len[i]);
+      len[i] = 0;
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct pollfd fds[MAXIN];
+  char buf[LINELEN];
+  int n = 3, lines = 10;
+  int i, m, p[2], open;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(argc > 2)
+    lines = atoi(argv[2]);
+  if(n < 1 || n > MAXIN || lines < 1){
+    printf(2, "usage: merge [pipes, up to %d] [lines]\n", MAXIN);
+    exit(EXIT_FAILURE);
+  }
+  for(i = 0; i < n; i++){
+    if(pipe(p) < 0){
+      printf(2, "merge: pipe failed\n");
+      exit(EXIT_FAILURE);
+    }
+    switch(fork()){
+    case -1:
+      printf(2, "merge: fork failed\n");
+      exit(EXIT_FAILURE);
+    case 0:
+      close(p[0]);
+      writer(p[1], i, lines);
+    }
+    close(p[1]);
+    fds[i].fd = p[0];
+    fds[i].events = POLLIN;
+    len[i] = 0;
+  }
+
+  for(open = n; open > 0; ){
+    if(poll(fds, n, -1) <= 0){
+      printf(2, "merge: poll failed\n");
+      exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < n; i++){
+      if(fds[i].revents == 0)
+        continue;
+      /* Sin escritores quedan por leer los datos pendientes: read() devuelve 0 al final. */
+      if((m = read(fds[i].fd, buf, sizeof(buf))) > 0){
+        add(i, buf, m);
+        continue;
+      }
+      if(len[i] > 0)
+        add(i, "\n", 1);
+      close(fds[i].fd);
+      fds[i].fd = -1;
+      open--;
+    }
+  }
+  for(i = 0; i < n; i++)
+    wait(NULL);
+  exit(EXIT_SUCCESS);
+}
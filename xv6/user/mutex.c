@@ -0,0 +1,79 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+/* Cerrojos y variables de condición para hilos (ver thread.c) o para procesos que compartan memoria, sobre futex_wait() y futex_wake(). Un cerrojo vale 0 si está libre, 1 si está cogido y 2 si además puede haber alguien esperando: cogerlo y soltarlo sin competencia cuesta un xchg y ninguna llamada al sistema. */
+
+void
+mutex_init(mutex_t *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(mutex_t *m)
+{
+  if(xchg(&m->state, 1) == 0)
+    return;
+  /* Hay competencia: se marca el cerrojo con 2 para que quien lo suelte nos despierte. */
+  while(xchg(&m->state, 2) != 0)
+    futex_wait(&m->state, 2);
+}
+
+/* Devuelve 0 si coge el cerrojo, o -1 si ya estaba cogido. */
+int
+mutex_trylock(mutex_t *m)
+{
+  /* Sólo se cambia un cerrojo libre: un xchg sobre uno cogido podría borrar el 2 y dejar sin despertar a quien espera. */
+  if(cmpxchg(&m->state, 0, 1) != 0)
+    return -1;
+  return 0;
+}
+
+void
+mutex_unlock(mutex_t *m)
+{
+  if(xchg(&m->state, 0) == 2)
+    futex_wake(&m->state, 1);
+}
+
+void
+cond_init(cond_t *c)
+{
+  c->seq = 0;
+  c->waiters = 0;
+}
+
+/* Suelta m, espera a un cond_signal() o cond_broadcast() y vuelve a coger m. Puede volver sin aviso: hay que comprobar otra vez la condición. */
+void
+cond_wait(cond_t *c, mutex_t *m)
+{
+  uint seq;
+
+  xadd(&c->waiters, 1);
+  seq = c->seq;
+  mutex_unlock(m);
+  /* Si alguien avisa entre medias seq ya ha cambiado y futex_wait() vuelve enseguida. */
+  futex_wait(&c->seq, seq);
+  xadd(&c->waiters, -1);
+  /* Puede haber más hilos despertados compitiendo por m: se coge como con competencia. */
+  while(xchg(&m->state, 2) != 0)
+    futex_wait(&m->state, 2);
+}
+
+void
+cond_signal(cond_t *c)
+{
+  xadd(&c->seq, 1);
+  if(c->waiters)
+    futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(cond_t *c)
+{
+  xadd(&c->seq, 1);
+  if(c->waiters)
+    futex_wake(&c->seq, c->waiters);
+}
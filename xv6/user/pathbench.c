@@ -0,0 +1,81 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "iostat.h"
+
+/* Benchmark de búsqueda de rutas: crea un árbol de depth directorios con un fichero al fondo y abre la ruta completa n veces; después repite con un nombre que no existe, que sólo puede resolverse deprisa si se cachean también las búsquedas fallidas. */
+
+#define MAXDEPTH 16
+
+char path[MAXDEPTH*3 + 16];
+
+static void
+lookups(char *what, char *p, int n, int expect)
+{
+  struct iostat st0, st1;
+  int i, fd, start, ticks;
+
+  iostat(&st0);
+  start = uptime();
+  for(i = 0; i < n; i++){
+    fd = open(p, O_RDONLY);
+    if((fd >= 0) != expect){
+      printf(2, "pathbench: open %s: unexpected result\n", p);
+      exit(EXIT_FAILURE);
+    }
+    if(fd >= 0)
+      close(fd);
+  }
+  ticks = uptime() - start;
+  iostat(&st1);
+  printf(1, "%s: %d opens in %d ticks, name cache %d hits %d misses, inode cache %d hits %d misses\n",
+         what, n, ticks, st1.dhits - st0.dhits, st1.dmisses - st0.dmisses,
+         st1.ihits - st0.ihits, st1.imisses - st0.imisses);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n = 2000, depth = 8, i, len, fd;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(argc > 2)
+    depth = atoi(argv[2]);
+  if(n < 1 || depth < 1 || depth > MAXDEPTH){
+    printf(2, "usage: pathbench [opens] [depth <= %d]\n", MAXDEPTH);
+    exit(EXIT_FAILURE);
+  }
+
+  strcpy(path, "pb");
+  len = 2;
+  mkdir(path);
+  for(i = 1; i < depth; i++){
+    path[len++] = '/';
+    path[len++] = 'd';
+    path[len++] = '0' + i % 10;
+    path[len] = 0;
+    mkdir(path);
+  }
+  strcpy(path + len, "/f");
+  if((fd = open(path, O_CREATE | O_RDWR)) < 0){
+    printf(2, "pathbench: cannot create %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+
+  lookups("hit", path, n, 1);
+  strcpy(path + len, "/nofile");
+  lookups("miss", path, n, 0);
+
+  /* Deshace el árbol, del fondo hacia arriba. */
+  strcpy(path + len, "/f");
+  unlink(path);
+  for(; len > 2; len -= 3){
+    path[len] = 0;
+    unlink(path);
+  }
+  unlink("pb");
+  exit(EXIT_SUCCESS);
+}
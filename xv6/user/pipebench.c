@@ -0,0 +1,84 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "iostat.h"
+
+/* Benchmark de tuberías: un hijo escribe kb KB en write() de chunk bytes y el padre los lee con read() del mismo tamaño. Da el caudal y los cambios de contexto por MB; el tercer argumento fija el tamaño del buffer de la tubería con fcntl(). Los buffers están alineados a página, así que con chunk múltiplo de 4096 las páginas pasan por referencia; con un cuarto argumento no nulo se desalinean para medir la copia. */
+
+#define MAXCHUNK 65536
+
+char *buf;
+
+int
+main(int argc, char *argv[])
+{
+  int kb = 4096, chunk = 4096, size = 0, misalign = 0;
+  int p[2], i, n, start, ticks;
+  uint total, left;
+  struct iostat st0, st1;
+
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(argc > 2)
+    chunk = atoi(argv[2]);
+  if(argc > 3)
+    size = atoi(argv[3]);
+  if(argc > 4)
+    misalign = atoi(argv[4]) != 0;
+  if(kb < 1 || chunk < 1 || chunk > MAXCHUNK){
+    printf(2, "usage: pipebench [kb] [chunk bytes <= %d] [pipe size] [misalign]\n", MAXCHUNK);
+    exit(EXIT_FAILURE);
+  }
+
+  if(pipe(p) < 0){
+    printf(2, "pipebench: pipe failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if(size > 0 && fcntl(p[1], F_SETPIPE_SZ, size) < 0){
+    printf(2, "pipebench: cannot set pipe size %d\n", size);
+    exit(EXIT_FAILURE);
+  }
+  size = fcntl(p[0], F_GETPIPE_SZ, 0);
+
+  buf = sbrk(MAXCHUNK + 2*4096);
+  buf = (char*)(((uint)buf + 4095) & ~4095) + misalign;
+  for(i = 0; i < chunk; i++)
+    buf[i] = i;
+  total = kb * 1024;
+
+  iostat(&st0);
+  start = uptime();
+  switch(fork()){
+  case -1:
+    printf(2, "pipebench: fork failed\n");
+    exit(EXIT_FAILURE);
+  case 0:
+    close(p[0]);
+    for(left = total; left > 0; left -= n){
+      n = left < chunk ? left : chunk;
+      if(write(p[1], buf, n) != n){
+        printf(2, "pipebench: write failed\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    exit(EXIT_SUCCESS);
+  }
+  close(p[1]);
+  for(left = total; left > 0; left -= n){
+    if((n = read(p[0], buf, chunk)) <= 0){
+      printf(2, "pipebench: short read\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  close(p[0]);
+  wait(NULL);
+  ticks = uptime() - start;
+  iostat(&st1);
+
+  if(ticks == 0)
+    ticks = 1;
+  printf(1, "pipe of %d bytes, %d byte %s chunks: %d KB in %d ticks (%d KB/s at 100 ticks/s), %d context switches per MB\n",
+         size, chunk, misalign ? "unaligned" : "aligned", kb, ticks, kb * 100 / ticks, (st1.nswitch - st0.nswitch) * 1024 / kb);
+  exit(EXIT_SUCCESS);
+}
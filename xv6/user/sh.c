@@ -1,6 +1,7 @@
 // Shell.
 
 #include "types.h"
+#include "stat.h"
 #include "user.h"
 #include "fcntl.h"
 
@@ -138,9 +139,7 @@ int
 getcmd(char *buf, int nbuf)
 {
   printf(2, "$ ");
-  memset(buf, 0, nbuf);
-  gets(buf, nbuf);
-  if(buf[0] == 0) // EOF
+  if(fgets(buf, nbuf, stdin) == 0) // EOF
     return -1;
   return 0;
 }
@@ -149,6 +148,7 @@ int
 main(void)
 {
   static char buf[100];
+  struct stat st;
   int fd;
 
   // Ensure that three file descriptors are open.
@@ -159,6 +159,12 @@ main(void)
     }
   }
 
+  // Commands run in children share stdin. What stdin reads ahead
+  // is given back to a file before each fork, but not to a pipe:
+  // read those a byte at a time.
+  if(fstat(0, &st) < 0)
+    setvbuf(stdin, 0, _IONBF, 0);
+
   // Read and run input commands.
   while(getcmd(buf, sizeof(buf)) >= 0){
     if(buf[0] == 'c' && buf[1] == 'd' && buf[2] == ' '){
@@ -0,0 +1,176 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+/* Productor/consumidor: un hijo envía kb KB al padre en bloques de chunk bytes, primero por un pipe y después por un anillo en un segmento de memoria compartida, y se comparan los ticks. Por el pipe cada bloque cuesta dos llamadas al sistema y, salvo que el pipe pueda pasar páginas enteras, dos copias (del productor al pipe y del pipe al consumidor); por el anillo se copia una vez a cada lado y no hay llamadas. Los índices del anillo los escribe un solo proceso cada uno, así que basta con que el compilador no reordene los accesos: en x86 las escrituras se ven en orden. Quien espera gira un rato y luego duerme un tick; tiene sentido con CPUS=2 o más. */
+
+#define RINGSIZE (64*1024)
+#define SPIN     100000
+
+struct ring {
+  volatile uint head;  // Bytes escritos por el productor
+  volatile uint tail;  // Bytes leídos por el consumidor
+  char data[RINGSIZE];
+};
+
+char buf[RINGSIZE];
+
+#define barrier() __asm__ volatile("" ::: "memory")
+
+static void
+fill(char *p, int n, uint pos)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    p[i] = pos + i;
+}
+
+/* Suma de comprobación de lo recibido: la misma que la de lo enviado por fill(). */
+static uint
+sum(char *p, int n)
+{
+  uint s;
+  int i;
+
+  s = 0;
+  for(i = 0; i < n; i++)
+    s += (uchar)p[i];
+  return s;
+}
+
+static uint
+expected(int total)
+{
+  uint s;
+  int i;
+
+  s = 0;
+  for(i = 0; i < total; i++)
+    s += (uchar)i;
+  return s;
+}
+
+/* Espera a que se cumpla cond, girando y después durmiendo. */
+#define WAIT(cond) do { \
+    int spins = 0; \
+    while(!(cond)){ \
+      if(++spins > SPIN){ \
+        sleep(1); \
+        spins = 0; \
+      } \
+    } \
+    barrier(); \
+  } while(0)
+
+static int
+pipexfer(int total, int chunk)
+{
+  int p[2], pid, n, m, start;
+  uint s;
+
+  if(pipe(p) < 0 || (pid = fork()) < 0){
+    printf(2, "shmbench: pipe or fork failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if(pid == 0){
+    close(p[0]);
+    for(n = 0; n < total; n += chunk){
+      fill(buf, chunk, n);
+      if(write(p[1], buf, chunk) != chunk)
+        exit(EXIT_FAILURE);
+    }
+    exit(EXIT_SUCCESS);
+  }
+  close(p[1]);
+  start = uptime();
+  s = 0;
+  for(n = 0; n < total; n += m){
+    if((m = read(p[0], buf, chunk)) <= 0){
+      printf(2, "shmbench: pipe read failed\n");
+      exit(EXIT_FAILURE);
+    }
+    s += sum(buf, m);
+  }
+  close(p[0]);
+  wait(NULL);
+  if(s != expected(total)){
+    printf(2, "shmbench: pipe data corrupted\n");
+    exit(EXIT_FAILURE);
+  }
+  return uptime() - start;
+}
+
+static int
+shmxfer(int total, int chunk)
+{
+  struct ring *r;
+  int id, pid, n, start;
+  uint s;
+
+  if((id = shmget(IPC_PRIVATE, sizeof(struct ring), IPC_CREAT)) < 0 ||
+     (r = shmat(id)) == (struct ring*)-1){
+    printf(2, "shmbench: cannot create the segment\n");
+    exit(EXIT_FAILURE);
+  }
+  shmctl(id, IPC_RMID);
+  if((pid = fork()) < 0){
+    printf(2, "shmbench: fork failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if(pid == 0){
+    for(n = 0; n < total; n += chunk){
+      fill(buf, chunk, n);
+      WAIT(r->head - r->tail <= RINGSIZE - chunk);
+      memmove(r->data + n % RINGSIZE, buf, chunk);
+      barrier();
+      r->head = n + chunk;
+    }
+    exit(EXIT_SUCCESS);
+  }
+  start = uptime();
+  s = 0;
+  for(n = 0; n < total; n += chunk){
+    WAIT(r->head - n >= chunk);
+    // chunk divide RINGSIZE: un bloque nunca da la vuelta al anillo.
+    memmove(buf, r->data + n % RINGSIZE, chunk);
+    barrier();
+    r->tail = n + chunk;
+    s += sum(buf, chunk);
+  }
+  wait(NULL);
+  shmdt(r);
+  if(s != expected(total)){
+    printf(2, "shmbench: shared memory data corrupted\n");
+    exit(EXIT_FAILURE);
+  }
+  return uptime() - start;
+}
+
+static void
+report(char *name, int kb, int ticks)
+{
+  if(ticks == 0)
+    ticks = 1;
+  printf(1, "%s: %d KB in %d ticks (%d KB/tick)\n", name, kb, ticks, kb / ticks);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kb = 4096, chunk = 4096;
+
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(argc > 2)
+    chunk = atoi(argv[2]);
+  if(kb < 1 || chunk < 1 || chunk > RINGSIZE || RINGSIZE % chunk != 0 ||
+     kb*1024 % chunk != 0){
+    printf(2, "usage: shmbench [kb] [chunk bytes, divides %d]\n", RINGSIZE);
+    exit(EXIT_FAILURE);
+  }
+  report("pipe", kb, pipexfer(kb*1024, chunk));
+  report("shm", kb, shmxfer(kb*1024, chunk));
+  exit(EXIT_SUCCESS);
+}
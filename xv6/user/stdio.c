@@ -0,0 +1,344 @@
+#include "types.h"
+#include "stat.h"
+#include "fcntl.h"
+#include "user.h"
+
+/* Flujos con buffer sobre los descriptores. stdout va por líneas si es la consola y con buffer completo si no; stderr va sin buffer; stdin y los flujos de fopen()/fdopen() con buffer completo. Lo pendiente se escribe al llenarse el buffer, con fflush() y, desde ulib.c, antes de fork(), exec() y exit(). */
+
+#define SEOF   0x1   // read() devolvió 0
+#define SERR   0x2   // read() o write() fallaron
+#define SSEEK  0x4   // fichero normal: lo leído de más se puede devolver con lseek()
+#define SALLOC 0x8   // buffer de malloc()
+#define SFREE  0x10  // flujo de malloc() (fdopen)
+
+struct stream {
+  int fd;
+  int mode;             // _IOFBF, _IOLBF o _IONBF; -1 hasta el primer uso
+  int flags;
+  char *buf;
+  int size;
+  int rpos, rlen;       // Lectura: siguiente byte y bytes válidos de buf
+  int wlen;             // Escritura: bytes pendientes en buf
+  char ch;              // Buffer de un byte de los flujos sin buffer
+  struct stream *next;  // Lista de todos los flujos, para fflush(0)
+};
+
+static char inbuf[BUFSIZ], outbuf[BUFSIZ];
+
+static FILE std[3] = {
+  { 0, -1, 0, inbuf, BUFSIZ, 0, 0, 0, 0, &std[1] },
+  { 1, -1, 0, outbuf, BUFSIZ, 0, 0, 0, 0, &std[2] },
+  { 2, -1, 0, &std[2].ch, 1, 0, 0, 0, 0, 0 },
+};
+
+FILE *stdin = &std[0];
+FILE *stdout = &std[1];
+FILE *stderr = &std[2];
+
+static FILE *streams = &std[0];
+
+/* Elige el modo del flujo en su primer uso. */
+static void
+setup(FILE *fp)
+{
+  struct stat st;
+
+  if(fp->mode >= 0)
+    return;
+  fp->mode = _IOFBF;
+  if(fstat(fp->fd, &st) == 0){
+    if(st.type == T_FILE)
+      fp->flags |= SSEEK;
+    if(st.type == T_DEV && fp->fd == 1)
+      fp->mode = _IOLBF;
+  }
+  if(fp->fd == 2)
+    fp->mode = _IONBF;
+  if(fp->buf == 0 && fp->mode != _IONBF && (fp->buf = malloc(BUFSIZ)) != 0){
+    fp->size = BUFSIZ;
+    fp->flags |= SALLOC;
+  }
+  if(fp->buf == 0)
+    fp->mode = _IONBF;
+  if(fp->mode == _IONBF){
+    fp->buf = &fp->ch;
+    fp->size = 1;
+  }
+}
+
+/* Escribe lo pendiente. */
+static int
+sflush(FILE *fp)
+{
+  int n, off;
+
+  for(off = 0; off < fp->wlen; off += n){
+    if((n = write(fp->fd, fp->buf + off, fp->wlen - off)) <= 0){
+      fp->flags |= SERR;
+      fp->wlen = 0;
+      return EOF;
+    }
+  }
+  fp->wlen = 0;
+  return 0;
+}
+
+/* Devuelve al fichero lo leído de más, para que lo vea quien comparte el descriptor (un hijo, o un write() posterior). En pipes y en la consola no se puede y se conserva. */
+static void
+unread(FILE *fp)
+{
+  if(fp->rpos == fp->rlen)
+    fp->rpos = fp->rlen = 0;
+  else if((fp->flags & SSEEK) && lseek(fp->fd, fp->rpos - fp->rlen, SEEK_CUR) >= 0)
+    fp->rpos = fp->rlen = 0;
+}
+
+int
+fflush(FILE *fp)
+{
+  int r;
+
+  if(fp == 0){
+    r = 0;
+    for(fp = streams; fp; fp = fp->next)
+      if(fflush(fp) < 0)
+        r = EOF;
+    return r;
+  }
+  unread(fp);
+  return sflush(fp);
+}
+
+int
+setvbuf(FILE *fp, char *buf, int mode, int size)
+{
+  int alloc;
+
+  if(mode != _IOFBF && mode != _IOLBF && mode != _IONBF)
+    return EOF;
+  setup(fp);
+  if(fflush(fp) < 0 || fp->rpos != fp->rlen)
+    return EOF;
+  alloc = 0;
+  if(mode == _IONBF){
+    buf = &fp->ch;
+    size = 1;
+  } else if(buf == 0 || size < 1){
+    // Sin buffer del llamante se queda con el suyo, o pide uno.
+    if(fp->size > 1){
+      buf = fp->buf;
+      size = fp->size;
+    } else {
+      if((buf = malloc(BUFSIZ)) == 0)
+        return EOF;
+      size = BUFSIZ;
+      alloc = SALLOC;
+    }
+  }
+  if(buf != fp->buf){
+    if(fp->flags & SALLOC)
+      free(fp->buf);
+    fp->flags = (fp->flags & ~SALLOC) | alloc;
+  }
+  fp->buf = buf;
+  fp->size = size;
+  fp->mode = mode;
+  return 0;
+}
+
+FILE*
+fdopen(int fd)
+{
+  FILE *fp;
+
+  if(fd < 0 || (fp = malloc(sizeof(*fp))) == 0)
+    return 0;
+  memset(fp, 0, sizeof(*fp));
+  fp->fd = fd;
+  fp->mode = -1;
+  fp->flags = SFREE;
+  fp->next = streams;
+  streams = fp;
+  return fp;
+}
+
+FILE*
+fopen(const char *path, int omode)
+{
+  FILE *fp;
+  int fd;
+
+  if((fd = open(path, omode)) < 0)
+    return 0;
+  if((fp = fdopen(fd)) == 0)
+    close(fd);
+  return fp;
+}
+
+int
+fclose(FILE *fp)
+{
+  FILE **pp;
+  int r;
+
+  r = fflush(fp);
+  if(close(fp->fd) < 0)
+    r = EOF;
+  fp->rpos = fp->rlen = 0;
+  if(fp->flags & SALLOC)
+    free(fp->buf);
+  if(fp->flags & SFREE){
+    for(pp = &streams; *pp; pp = &(*pp)->next)
+      if(*pp == fp){
+        *pp = fp->next;
+        break;
+      }
+    free(fp);
+  }
+  return r;
+}
+
+int
+fileno(FILE *fp)
+{
+  return fp->fd;
+}
+
+int
+feof(FILE *fp)
+{
+  return (fp->flags & SEOF) != 0;
+}
+
+int
+ferror(FILE *fp)
+{
+  return (fp->flags & SERR) != 0;
+}
+
+/* Escribe n bytes en el flujo; devuelve n, o EOF si falla write(). Lo que no cabe en un buffer vacío va directo al descriptor. */
+int
+fwrite(const void *p, int n, FILE *fp)
+{
+  const char *s = p;
+  int done, m;
+
+  setup(fp);
+  unread(fp);
+  for(done = 0; done < n; done += m){
+    if(fp->wlen == 0 && n - done >= fp->size){
+      if((m = write(fp->fd, s + done, n - done)) <= 0){
+        fp->flags |= SERR;
+        return EOF;
+      }
+      continue;
+    }
+    m = n - done;
+    if(m > fp->size - fp->wlen)
+      m = fp->size - fp->wlen;
+    memmove(fp->buf + fp->wlen, s + done, m);
+    fp->wlen += m;
+    if(fp->wlen == fp->size && sflush(fp) < 0)
+      return EOF;
+  }
+  if(fp->mode == _IOLBF && fp->wlen > 0){
+    for(m = 0; m < n; m++)
+      if(s[m] == '\n')
+        return sflush(fp) < 0 ? EOF : n;
+  }
+  return n;
+}
+
+int
+fputc(int c, FILE *fp)
+{
+  char ch = c;
+
+  if(fwrite(&ch, 1, fp) != 1)
+    return EOF;
+  return (uchar)ch;
+}
+
+int
+fputs(const char *s, FILE *fp)
+{
+  return fwrite(s, strlen(s), fp) < 0 ? EOF : 0;
+}
+
+/* Un read() del flujo. Antes se escribe lo pendiente en él y, si stdout va por líneas, en stdout: así se ve el prompt antes de esperar a la entrada. */
+static int
+sread(FILE *fp, void *p, int n)
+{
+  if(sflush(fp) < 0)
+    return -1;
+  if(fp != stdout && stdout->mode == _IOLBF)
+    sflush(stdout);
+  n = read(fp->fd, p, n);
+  if(n == 0)
+    fp->flags |= SEOF;
+  else if(n < 0)
+    fp->flags |= SERR;
+  return n;
+}
+
+/* Como read(): devuelve lo que quede en el buffer o, si está vacío, lo que dé un read(), sin esperar a tener n bytes. 0 al final del fichero. */
+int
+fread(void *p, int n, FILE *fp)
+{
+  int m;
+
+  setup(fp);
+  if(fp->rpos == fp->rlen){
+    if(n >= fp->size)
+      return sread(fp, p, n);
+    if((m = sread(fp, fp->buf, fp->size)) <= 0)
+      return m;
+    fp->rpos = 0;
+    fp->rlen = m;
+  }
+  m = fp->rlen - fp->rpos;
+  if(m > n)
+    m = n;
+  memmove(p, fp->buf + fp->rpos, m);
+  fp->rpos += m;
+  return m;
+}
+
+int
+fgetc(FILE *fp)
+{
+  int n;
+
+  if(fp->rpos == fp->rlen){
+    setup(fp);
+    if((n = sread(fp, fp->buf, fp->size)) <= 0)
+      return EOF;
+    fp->rpos = 0;
+    fp->rlen = n;
+  }
+  return (uchar)fp->buf[fp->rpos++];
+}
+
+/* Lee hasta un fin de línea (incluido) o max-1 bytes. Devuelve 0 si no había nada que leer. */
+char*
+fgets(char *buf, int max, FILE *fp)
+{
+  int i, c;
+
+  for(i = 0; i+1 < max; ){
+    if((c = fgetc(fp)) == EOF)
+      break;
+    buf[i++] = c;
+    if(c == '\n')
+      break;
+  }
+  buf[i] = '\0';
+  return i > 0 ? buf : 0;
+}
+
+char*
+gets(char *buf, int max)
+{
+  fgets(buf, max, stdin);
+  return buf;
+}
@@ -0,0 +1,111 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "iostat.h"
+
+/* Benchmark de stdio: escribe n líneas como las de ls con printf() sobre un fichero de tres formas: un write() por carácter (el printf() de antes), sin buffer (un write() por printf()) y con buffer completo. Da las llamadas al sistema (contadas por iostat()) y los ticks de cada una. */
+
+static int t0;
+static uint sc0;
+
+static void
+begin(void)
+{
+  struct iostat st;
+
+  iostat(&st);
+  sc0 = st.nsyscall;
+  t0 = uptime();
+}
+
+static void
+end(char *what, int n)
+{
+  struct iostat st;
+  int ticks;
+
+  ticks = uptime() - t0;
+  iostat(&st);
+  /* La llamada a iostat() de begin() ya está contada. */
+  printf(1, "%s: %d lines, %d syscalls, %d ticks\n", what, n, st.nsyscall - sc0 - 1, ticks);
+}
+
+/* El printf() de antes de stdio: un write() por carácter. */
+static void
+putcs(int fd, char *s)
+{
+  for(; *s; s++)
+    write(fd, s, 1);
+}
+
+static void
+charline(int fd, int i)
+{
+  char num[16];
+  int j, k;
+
+  putcs(fd, "name          2 ");
+  j = 0;
+  k = i;
+  do{
+    num[j++] = '0' + k % 10;
+  }while((k /= 10) != 0);
+  while(--j >= 0)
+    write(fd, &num[j], 1);
+  putcs(fd, " 4096\n");
+}
+
+static FILE*
+create(char *path)
+{
+  FILE *fp;
+
+  if((fp = fopen(path, O_CREATE | O_RDWR)) == 0){
+    printf(2, "stdiobench: cannot create %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  return fp;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *path = "stdiobench.tmp";
+  FILE *fp;
+  int n = 2000, i;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1){
+    printf(2, "usage: stdiobench [lines]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  fp = create(path);
+  begin();
+  for(i = 0; i < n; i++)
+    charline(fileno(fp), i);
+  end("write per char", n);
+  fclose(fp);
+  unlink(path);
+
+  fp = create(path);
+  setvbuf(fp, 0, _IONBF, 0);
+  begin();
+  for(i = 0; i < n; i++)
+    fprintf(fp, "name          2 %d 4096\n", i);
+  end("unbuffered", n);
+  fclose(fp);
+  unlink(path);
+
+  fp = create(path);
+  begin();
+  for(i = 0; i < n; i++)
+    fprintf(fp, "name          2 %d 4096\n", i);
+  fflush(fp);
+  end("buffered", n);
+  fclose(fp);
+  unlink(path);
+  exit(EXIT_SUCCESS);
+}
@@ -16,16 +16,18 @@
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  int fd, i, me, start;
   char path[] = "stressfs0";
   char data[512];
 
   printf(1, "stressfs starting\n");
   memset(data, 'a', sizeof(data));
+  start = uptime();
 
   for(i = 0; i < 4; i++)
     if(fork() > 0)
       break;
+  me = i;
 
   printf(1, "write %d\n", i);
 
@@ -45,5 +47,9 @@ main(int argc, char *argv[])
 
   wait(NULL);
 
+  // The first process waits for all the others, one by one.
+  if(me == 0)
+    printf(1, "stressfs: %d ticks\n", uptime() - start);
+
   exit(EXIT_SUCCESS);
 }
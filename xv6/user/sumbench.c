@@ -0,0 +1,104 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+/* Suma en paralelo: reparte un vector de mb MB entre 1, 2, ..., nthreads hilos (ver thread.c), que lo suman reps veces cada uno su trozo, y compara los ticks con los de un solo hilo. Los hilos comparten la memoria, así que el vector no se copia: se rellena antes de crearlos para que ya no haya fallos de página. Tiene sentido con CPUS=4. */
+
+#define MAXTHREADS 8
+
+struct part {
+  uint *a;
+  int n;
+  int reps;
+  uint sum;
+  char pad[48];  // Cada resultado en su línea de caché
+};
+
+struct part parts[MAXTHREADS];
+
+static void
+sum(void *arg)
+{
+  struct part *p = arg;
+  uint s;
+  int i, r;
+
+  s = 0;
+  for(r = 0; r < p->reps; r++)
+    for(i = 0; i < p->n; i++)
+      s += p->a[i];
+  p->sum = s;
+}
+
+/* Suma el vector con t hilos; devuelve los ticks y deja la suma en *total. */
+static int
+run(uint *a, int n, int t, int reps, uint *total)
+{
+  int i, start, tid[MAXTHREADS];
+
+  start = uptime();
+  for(i = 0; i < t; i++){
+    parts[i].a = a + n * i / t;
+    parts[i].n = n * (i + 1) / t - n * i / t;
+    parts[i].reps = reps;
+    if((tid[i] = thread_create(sum, &parts[i])) < 0){
+      printf(2, "sumbench: thread_create failed\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  *total = 0;
+  for(i = 0; i < t; i++){
+    if(thread_join(tid[i]) != tid[i]){
+      printf(2, "sumbench: thread_join failed\n");
+      exit(EXIT_FAILURE);
+    }
+    *total += parts[i].sum;
+  }
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nthreads = 4, mb = 4, reps = 20;
+  int n, i, t, ticks, ticks1;
+  uint *a, want, total;
+
+  if(argc > 1)
+    nthreads = atoi(argv[1]);
+  if(argc > 2)
+    mb = atoi(argv[2]);
+  if(argc > 3)
+    reps = atoi(argv[3]);
+  if(nthreads < 1 || nthreads > MAXTHREADS || mb < 1 || reps < 1){
+    printf(2, "usage: sumbench [threads, up to %d] [mb] [reps]\n", MAXTHREADS);
+    exit(EXIT_FAILURE);
+  }
+  n = mb * 1024 * 1024 / sizeof(uint);
+  if((a = malloc(n * sizeof(uint))) == 0){
+    printf(2, "sumbench: out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  want = 0;
+  for(i = 0; i < n; i++){
+    a[i] = i;
+    want += i;
+  }
+  want *= reps;
+
+  ticks1 = 0;
+  for(t = 1; t <= nthreads; t++){
+    ticks = run(a, n, t, reps, &total);
+    if(total != want){
+      printf(2, "sumbench: wrong sum with %d threads\n", t);
+      exit(EXIT_FAILURE);
+    }
+    if(ticks == 0)
+      ticks = 1;
+    if(t == 1)
+      ticks1 = ticks;
+    printf(1, "%d threads: %d ticks, speed-up %d.%d\n",
+           t, ticks, ticks1 / ticks, ticks1 * 10 / ticks % 10);
+  }
+  exit(EXIT_SUCCESS);
+}
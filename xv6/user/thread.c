@@ -0,0 +1,49 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+/* Hilos sobre clone() y join(). Cada hilo recibe una pila de malloc() de THREADSTACK bytes, con su función y su argumento al principio, y acaba con _exit() al volver: exit() vaciaría los flujos de stdio, que comparte con los demás hilos. Ni stdio ni malloc() se protegen con cerrojos, así que sólo debe usarlos un hilo a la vez. */
+
+#define THREADSTACK (4*4096)
+
+struct tstart {
+  void (*fn)(void*);
+  void *arg;
+};
+
+static void
+tstart(void *p)
+{
+  struct tstart *t = p;
+
+  t->fn(t->arg);
+  _exit(EXIT_SUCCESS);
+}
+
+/* Crea un hilo que ejecuta fn(arg). Devuelve su identificador, o -1. */
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  struct tstart *t;
+  int tid;
+
+  if((t = malloc(THREADSTACK)) == 0)
+    return -1;
+  t->fn = fn;
+  t->arg = arg;
+  if((tid = clone(tstart, t, t + 1, THREADSTACK - sizeof(*t))) < 0)
+    free(t);
+  return tid;
+}
+
+/* Espera a que acabe el hilo tid (o cualquiera, si tid es 0) y libera su pila. Devuelve su identificador, o -1 si no hay tal hilo. */
+int
+thread_join(int tid)
+{
+  void *stack;
+
+  if((tid = join(tid, &stack)) < 0)
+    return -1;
+  free((struct tstart*)stack - 1);
+  return tid;
+}
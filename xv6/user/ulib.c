@@ -55,24 +55,6 @@ strchr(const char *s, char c)
   return 0;
 }
 
-char*
-gets(char *buf, int max)
-{
-  int i, cc;
-  char c;
-
-  for(i=0; i+1 < max; ){
-    cc = read(0, &c, 1);
-    if(cc < 1)
-      break;
-    buf[i++] = c;
-    if(c == '\n' || c == '\r')
-      break;
-  }
-  buf[i] = '\0';
-  return buf;
-}
-
 int
 stat(const char *n, struct stat *st)
 {
@@ -110,3 +92,32 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// The stdio streams are only linked in when a program uses
+// them; through this weak reference fork, exec and exit flush
+// them if so, without pulling them into every program.
+#pragma weak fflush
+
+int
+fork(void)
+{
+  if(fflush)
+    fflush(0);
+  return _fork();
+}
+
+int
+exec(char *path, char **argv)
+{
+  if(fflush)
+    fflush(0);
+  return _exec(path, argv);
+}
+
+int
+exit(int status)
+{
+  if(fflush)
+    fflush(0);
+  _exit(status);
+}
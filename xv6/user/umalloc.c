@@ -3,88 +3,207 @@
 #include "user.h"
 #include "param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+/* Asignador por clases de tamaño. Los bloques de hasta MAXSMALL bytes salen de slabs: páginas de una sola clase (16, 32, ..., 1024 bytes) con su lista de objetos libres. Cada clase tiene la lista de sus slabs con sitio, así que malloc() y free() de bloques pequeños son O(1): free() encuentra la cabecera del slab redondeando el puntero a la página. Los bloques mayores son tramos de páginas con la cabecera en la primera. Las páginas libres forman una lista por orden de dirección, se fusionan con sus vecinas y, cuando un tramo libre de al menos TRIM páginas queda en la cima de la heap, se devuelve con un sbrk() negativo. */
 
-typedef long Align;
+#define PGSIZE   4096
+#define PGROUNDUP(a) (((a) + PGSIZE-1) & ~(PGSIZE-1))
+#define NCLASS   7                         // Clases de 16 a 1024 bytes
+#define MINSIZE  16
+#define MAXSMALL (MINSIZE << (NCLASS-1))
+#define MAXLARGE 0x40000000
+#define LARGE    NCLASS                    // cls de un bloque grande
+#define FREE     (NCLASS+1)                // cls de un tramo de páginas libre
+#define GROW     8                         // Páginas mínimas por sbrk()
+#define TRIM     16                        // Páginas libres en la cima para devolverlas
 
-union header {
-  struct {
-    union header *ptr;
-    uint size;
-  } s;
-  Align x;
+struct page {
+  uint cls;                  // Clase del slab, LARGE o FREE
+  uint npages;               // Bloque grande o tramo libre: longitud en páginas
+  int nfree;                 // Slab: objetos libres
+  void *free;                // Slab: lista de objetos libres
+  struct page *prev, *next;  // Slab: lista de su clase. Tramo libre: lista de tramos
 };
 
-typedef union header Header;
+#define HDRSIZE ((sizeof(struct page) + MINSIZE-1) & ~(MINSIZE-1))
+#define NOBJ(c) ((PGSIZE - HDRSIZE) / (MINSIZE << (c)))
 
-static Header base;
-static Header *freep;
+static struct page *partial[NCLASS];  // Slabs con objetos libres, por clase
+static struct page *freepages;        // Tramos libres, por dirección
 
-void
-free(void *ap)
+static void
+listpush(struct page **head, struct page *pg)
+{
+  pg->prev = 0;
+  pg->next = *head;
+  if(*head)
+    (*head)->prev = pg;
+  *head = pg;
+}
+
+static void
+listremove(struct page **head, struct page *pg)
 {
-  Header *bp, *p;
-
-  bp = (Header*)ap - 1;
-  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if(bp + bp->s.size == p->s.ptr){
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
-  } else
-    bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
-  } else
-    p->s.ptr = bp;
-  freep = p;
+  if(pg->prev)
+    pg->prev->next = pg->next;
+  else
+    *head = pg->next;
+  if(pg->next)
+    pg->next->prev = pg->prev;
 }
 
-static Header*
-morecore(uint nu)
+static char*
+pgend(struct page *pg)
 {
+  return (char*)pg + pg->npages*PGSIZE;
+}
+
+/* Devuelve un tramo de npages páginas a la lista de libres, fusionándolo con sus vecinos. */
+static void
+pgfree(struct page *pg, uint npages)
+{
+  struct page *prev, *next;
+
+  pg->cls = FREE;
+  pg->npages = npages;
+  prev = 0;
+  for(next = freepages; next && next < pg; next = next->next)
+    prev = next;
+  pg->prev = prev;
+  pg->next = next;
+  if(prev)
+    prev->next = pg;
+  else
+    freepages = pg;
+  if(next)
+    next->prev = pg;
+
+  if(next && pgend(pg) == (char*)next){
+    pg->npages += next->npages;
+    listremove(&freepages, next);
+  }
+  if(prev && pgend(prev) == (char*)pg){
+    prev->npages += pg->npages;
+    listremove(&freepages, pg);
+    pg = prev;
+  }
+  if(pg->npages >= TRIM && pg->next == 0 && pgend(pg) == sbrk(0)){
+    listremove(&freepages, pg);
+    sbrk(-(pg->npages*PGSIZE));
+  }
+}
+
+/* Toma npages páginas contiguas del primer tramo libre que las tenga o, si no hay, con sbrk(). */
+static struct page*
+pgalloc(uint npages)
+{
+  struct page *pg, *rest;
+  uint n, pad;
   char *p;
-  Header *hp;
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
-  if(p == (char*)-1)
+  for(pg = freepages; pg; pg = pg->next){
+    if(pg->npages < npages)
+      continue;
+    if(pg->npages > npages){
+      rest = (struct page*)((char*)pg + npages*PGSIZE);
+      rest->cls = FREE;
+      rest->npages = pg->npages - npages;
+      rest->prev = pg->prev;
+      rest->next = pg->next;
+      if(rest->prev)
+        rest->prev->next = rest;
+      else
+        freepages = rest;
+      if(rest->next)
+        rest->next->prev = rest;
+    } else
+      listremove(&freepages, pg);
+    pg->npages = npages;
+    return pg;
+  }
+
+  n = npages < GROW ? GROW : npages;
+  p = sbrk(0);
+  pad = PGROUNDUP((uint)p) - (uint)p;
+  if((p = sbrk(pad + n*PGSIZE)) == (char*)-1)
     return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
-  return freep;
+  pg = (struct page*)(p + pad);
+  if(n > npages)
+    pgfree((struct page*)((char*)pg + npages*PGSIZE), n - npages);
+  pg->npages = npages;
+  return pg;
+}
+
+/* Nuevo slab de la clase c, con todos sus objetos en su lista de libres. */
+static struct page*
+slabnew(int c)
+{
+  struct page *pg;
+  uint size;
+  char *o;
+
+  if((pg = pgalloc(1)) == 0)
+    return 0;
+  size = MINSIZE << c;
+  pg->cls = c;
+  pg->free = 0;
+  pg->nfree = 0;
+  // Los objetos se alinean a su tamaño contando desde el final de la página.
+  for(o = (char*)pg + PGSIZE - size; o >= (char*)pg + HDRSIZE; o -= size){
+    *(void**)o = pg->free;
+    pg->free = o;
+    pg->nfree++;
+  }
+  listpush(&partial[c], pg);
+  return pg;
+}
+
+void
+free(void *ap)
+{
+  struct page *pg;
+  uint c;
+
+  if(ap == 0)
+    return;
+  pg = (struct page*)((uint)ap & ~(PGSIZE-1));
+  if(pg->cls == LARGE){
+    pgfree(pg, pg->npages);
+    return;
+  }
+  c = pg->cls;
+  *(void**)ap = pg->free;
+  pg->free = ap;
+  if(pg->nfree++ == 0)
+    listpush(&partial[c], pg);
+  // Un slab vacío vuelve a las páginas libres si su clase tiene otro con sitio.
+  if(pg->nfree == NOBJ(c) && (pg->prev || pg->next)){
+    listremove(&partial[c], pg);
+    pgfree(pg, 1);
+  }
 }
 
 void*
 malloc(uint nbytes)
 {
-  Header *p, *prevp;
-  uint nunits;
+  struct page *pg;
+  void *p;
+  int c;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
-  }
-  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){
-      if(p->s.size == nunits)
-        prevp->s.ptr = p->s.ptr;
-      else {
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
-      }
-      freep = prevp;
-      return (void*)(p + 1);
-    }
-    if(p == freep)
-      if((p = morecore(nunits)) == 0)
-        return 0;
+  if(nbytes > MAXSMALL){
+    if(nbytes > MAXLARGE)
+      return 0;
+    if((pg = pgalloc(PGROUNDUP(nbytes + HDRSIZE) / PGSIZE)) == 0)
+      return 0;
+    pg->cls = LARGE;
+    return (char*)pg + HDRSIZE;
   }
+  for(c = 0; (MINSIZE << c) < nbytes; c++)
+    ;
+  if((pg = partial[c]) == 0 && (pg = slabnew(c)) == 0)
+    return 0;
+  p = pg->free;
+  pg->free = *(void**)p;
+  if(--pg->nfree == 0)
+    listremove(&partial[c], pg);
+  return p;
 }
@@ -1,7 +1,15 @@
 struct stat;
 struct rtcdate;
+struct iostat;
+struct iovec;
+struct pollfd;
 
 // system calls
+// fork, exit and exec are wrappers in ulib.c that flush the
+// stdio streams first; these are the bare system calls.
+extern int _fork(void);
+extern int _exit(int) __attribute__((noreturn));
+extern int _exec(char*, char**);
 extern int fork(void);
 
 /* --- Boletín 1. Ejercicio 3. --- */
@@ -37,6 +45,29 @@ extern int dup2(int, int);
 extern enum proc_prio getprio(int);
 extern int setprio(int, enum proc_prio);
 
+extern int lockstat(int);
+extern int lockbench(int, uint*);
+extern int iostat(struct iostat*);
+extern int fcntl(int, int, int);
+extern int splice(int, int, int);
+extern int readv(int, struct iovec*, int);
+extern int writev(int, struct iovec*, int);
+extern int pread(int, void*, int, int);
+extern int pwrite(int, const void*, int, int);
+extern int lseek(int, int, int);
+extern void* mmap(void*, int, int, int, int, int);
+extern int munmap(void*, int);
+extern int msync(void*, int);
+extern int shmget(int, int, int);
+extern void* shmat(int);
+extern int shmdt(void*);
+extern int shmctl(int, int);
+extern int clone(void(*)(void*), void*, void*, int);
+extern int join(int, void**);
+extern int futex_wait(volatile uint*, uint);
+extern int futex_wake(volatile uint*, int);
+extern int poll(struct pollfd*, int, int);
+
 // ulib.c
 extern int stat(const char*, struct stat*);
 extern char* strcpy(char*, const char*);
@@ -44,13 +75,58 @@ extern void *memmove(void*, const void*, int);
 extern char* strchr(const char*, char c);
 extern int strcmp(const char*, const char*);
 extern void printf(int, const char*, ...);
-extern char* gets(char*, int max);
 extern uint strlen(const char*);
 extern void* memset(void*, int, uint);
 extern void* malloc(uint);
 extern void free(void*);
 extern int atoi(const char*);
 
+// stdio.c
+#define BUFSIZ 512
+#define EOF    (-1)
+#define _IOFBF 0  // full buffering
+#define _IOLBF 1  // line buffering
+#define _IONBF 2  // no buffering
+typedef struct stream FILE;
+extern FILE *stdin, *stdout, *stderr;
+extern FILE* fopen(const char*, int omode);
+extern FILE* fdopen(int);
+extern int fclose(FILE*);
+extern int fflush(FILE*);
+extern int setvbuf(FILE*, char*, int mode, int size);
+extern int fileno(FILE*);
+extern int feof(FILE*);
+extern int ferror(FILE*);
+extern int fread(void*, int, FILE*);
+extern int fwrite(const void*, int, FILE*);
+extern int fgetc(FILE*);
+extern int fputc(int, FILE*);
+extern int fputs(const char*, FILE*);
+extern char* fgets(char*, int max, FILE*);
+extern char* gets(char*, int max);
+extern void fprintf(FILE*, const char*, ...);
+
+// thread.c
+extern int thread_create(void(*)(void*), void*);
+extern int thread_join(int);
+
+// mutex.c
+typedef struct {
+  volatile uint state;
+} mutex_t;
+typedef struct {
+  volatile uint seq;
+  volatile uint waiters;
+} cond_t;
+extern void mutex_init(mutex_t*);
+extern void mutex_lock(mutex_t*);
+extern int mutex_trylock(mutex_t*);
+extern void mutex_unlock(mutex_t*);
+extern void cond_init(cond_t*);
+extern void cond_wait(cond_t*, mutex_t*);
+extern void cond_signal(cond_t*);
+extern void cond_broadcast(cond_t*);
+
 #define NULL 0
 
 /* --- Boletín 1. Ejercicio 3. --- */
@@ -7,35 +7,35 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "iostat.h"
 
 char buf[8192];
 char name[3];
 char *echoargv[] = { "echo", "ALL", "TESTS", "PASSED", 0 };
-int stdout = 1;
 
 // does chdir() call iput(p->cwd) in a transaction?
 void
 iputtest(void)
 {
-  printf(stdout, "iput test\n");
+  fprintf(stdout, "iput test\n");
 
   if(mkdir("iputdir") < 0){
-    printf(stdout, "mkdir failed\n");
+    fprintf(stdout, "mkdir failed\n");
     exit(EXIT_FAILURE);
   }
   if(chdir("iputdir") < 0){
-    printf(stdout, "chdir iputdir failed\n");
+    fprintf(stdout, "chdir iputdir failed\n");
     exit(EXIT_FAILURE);
   }
   if(unlink("../iputdir") < 0){
-    printf(stdout, "unlink ../iputdir failed\n");
+    fprintf(stdout, "unlink ../iputdir failed\n");
     exit(EXIT_FAILURE);
   }
   if(chdir("/") < 0){
-    printf(stdout, "chdir / failed\n");
+    fprintf(stdout, "chdir / failed\n");
     exit(EXIT_FAILURE);
   }
-  printf(stdout, "iput test ok\n");
+  fprintf(stdout, "iput test ok\n");
 }
 
 // does exit(EXIT_SUCCESS) call iput(p->cwd) in a transaction?
@@ -44,30 +44,30 @@ exitiputtest(void)
 {
   int pid;
 
-  printf(stdout, "exitiput test\n");
+  fprintf(stdout, "exitiput test\n");
 
   pid = fork();
   if(pid < 0){
-    printf(stdout, "fork failed\n");
+    fprintf(stdout, "fork failed\n");
     exit(EXIT_FAILURE);
   }
   if(pid == 0){
     if(mkdir("iputdir") < 0){
-      printf(stdout, "mkdir failed\n");
+      fprintf(stdout, "mkdir failed\n");
       exit(EXIT_FAILURE);
     }
     if(chdir("iputdir") < 0){
-      printf(stdout, "child chdir failed\n");
+      fprintf(stdout, "child chdir failed\n");
       exit(EXIT_FAILURE);
     }
     if(unlink("../iputdir") < 0){
-      printf(stdout, "unlink ../iputdir failed\n");
+      fprintf(stdout, "unlink ../iputdir failed\n");
       exit(EXIT_FAILURE);
     }
     exit(EXIT_SUCCESS);
   }
   wait(NULL);
-  printf(stdout, "exitiput test ok\n");
+  fprintf(stdout, "exitiput test ok\n");
 }
 
 // does the error path in open() for attempt to write a
@@ -86,31 +86,31 @@ openiputtest(void)
 {
   int pid;
 
-  printf(stdout, "openiput test\n");
+  fprintf(stdout, "openiput test\n");
   if(mkdir("oidir") < 0){
-    printf(stdout, "mkdir oidir failed\n");
+    fprintf(stdout, "mkdir oidir failed\n");
     exit(EXIT_FAILURE);
   }
   pid = fork();
   if(pid < 0){
-    printf(stdout, "fork failed\n");
+    fprintf(stdout, "fork failed\n");
     exit(EXIT_FAILURE);
   }
   if(pid == 0){
     int fd = open("oidir", O_RDWR);
     if(fd >= 0){
-      printf(stdout, "open directory for write succeeded\n");
+      fprintf(stdout, "open directory for write succeeded\n");
       exit(EXIT_SUCCESS);
     }
     exit(EXIT_SUCCESS);
   }
   sleep(1);
   if(unlink("oidir") != 0){
-    printf(stdout, "unlink failed\n");
+    fprintf(stdout, "unlink failed\n");
     exit(EXIT_FAILURE);
   }
   wait(NULL);
-  printf(stdout, "openiput test ok\n");
+  fprintf(stdout, "openiput test ok\n");
 }
 
 // simple file system tests
@@ -120,19 +120,19 @@ opentest(void)
 {
   int fd;
 
-  printf(stdout, "open test\n");
+  fprintf(stdout, "open test\n");
   fd = open("echo", 0);
   if(fd < 0){
-    printf(stdout, "open echo failed!\n");
+    fprintf(stdout, "open echo failed!\n");
     exit(EXIT_FAILURE);
   }
   close(fd);
   fd = open("doesnotexist", 0);
   if(fd >= 0){
-    printf(stdout, "open doesnotexist succeeded!\n");
+    fprintf(stdout, "open doesnotexist succeeded!\n");
     exit(EXIT_SUCCESS);
   }
-  printf(stdout, "open test ok\n");
+  fprintf(stdout, "open test ok\n");
 }
 
 void
@@ -141,66 +141,70 @@ writetest(void)
   int fd;
   int i;
 
-  printf(stdout, "small file test\n");
+  fprintf(stdout, "small file test\n");
   fd = open("small", O_CREATE|O_RDWR);
   if(fd >= 0){
-    printf(stdout, "creat small succeeded; ok\n");
+    fprintf(stdout, "creat small succeeded; ok\n");
   } else {
-    printf(stdout, "error: creat small failed!\n");
+    fprintf(stdout, "error: creat small failed!\n");
     exit(EXIT_FAILURE);
   }
   for(i = 0; i < 100; i++){
     if(write(fd, "aaaaaaaaaa", 10) != 10){
-      printf(stdout, "error: write aa %d new file failed\n", i);
+      fprintf(stdout, "error: write aa %d new file failed\n", i);
       exit(EXIT_FAILURE);
     }
     if(write(fd, "bbbbbbbbbb", 10) != 10){
-      printf(stdout, "error: write bb %d new file failed\n", i);
+      fprintf(stdout, "error: write bb %d new file failed\n", i);
       exit(EXIT_FAILURE);
     }
   }
-  printf(stdout, "writes ok\n");
+  fprintf(stdout, "writes ok\n");
   close(fd);
   fd = open("small", O_RDONLY);
   if(fd >= 0){
-    printf(stdout, "open small succeeded ok\n");
+    fprintf(stdout, "open small succeeded ok\n");
   } else {
-    printf(stdout, "error: open small failed!\n");
+    fprintf(stdout, "error: open small failed!\n");
     exit(EXIT_FAILURE);
   }
   i = read(fd, buf, 2000);
   if(i == 2000){
-    printf(stdout, "read succeeded ok\n");
+    fprintf(stdout, "read succeeded ok\n");
   } else {
-    printf(stdout, "read failed\n");
+    fprintf(stdout, "read failed\n");
     exit(EXIT_FAILURE);
   }
   close(fd);
 
   if(unlink("small") < 0){
-    printf(stdout, "unlink small failed\n");
+    fprintf(stdout, "unlink small failed\n");
     exit(EXIT_FAILURE);
   }
-  printf(stdout, "small file test ok\n");
+  fprintf(stdout, "small file test ok\n");
 }
 
+// Blocks written by writetest1(): through the indirect block and
+// into the doubly-indirect ones, without filling the disk.
+#define BIGFILE (NDIRECT + NINDIRECT + 16)
+
 void
 writetest1(void)
 {
   int i, fd, n;
 
-  printf(stdout, "big files test\n");
+  fprintf(stdout, "big files test\n");
 
   fd = open("big", O_CREATE|O_RDWR);
   if(fd < 0){
-    printf(stdout, "error: creat big failed!\n");
+    fprintf(stdout, "error: creat big failed!\n");
     exit(EXIT_FAILURE);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGFILE; i++){
     ((int*)buf)[0] = i;
-    if(write(fd, buf, 512) != 512){
-      printf(stdout, "error: write big file failed\n", i);
+    if(write(fd, buf, BSIZE) != BSIZE){
+      fprintf(stdout, "error: write big file failed\n", i);
       exit(EXIT_FAILURE);
     }
   }
@@ -209,25 +213,25 @@ writetest1(void)
 
   fd = open("big", O_RDONLY);
   if(fd < 0){
-    printf(stdout, "error: open big failed!\n");
+    fprintf(stdout, "error: open big failed!\n");
     exit(EXIT_FAILURE);
   }
 
   n = 0;
   for(;;){
-    i = read(fd, buf, 512);
+    i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
-        printf(stdout, "read only %d blocks from big", n);
+      if(n == BIGFILE - 1){
+        fprintf(stdout, "read only %d blocks from big", n);
         exit(EXIT_SUCCESS);
       }
       break;
-    } else if(i != 512){
-      printf(stdout, "read failed %d\n", i);
+    } else if(i != BSIZE){
+      fprintf(stdout, "read failed %d\n", i);
       exit(EXIT_FAILURE);
     }
     if(((int*)buf)[0] != n){
-      printf(stdout, "read content of block %d is %d\n",
+      fprintf(stdout, "read content of block %d is %d\n",
              n, ((int*)buf)[0]);
       exit(EXIT_SUCCESS);
     }
@@ -235,10 +239,10 @@ writetest1(void)
   }
   close(fd);
   if(unlink("big") < 0){
-    printf(stdout, "unlink big failed\n");
+    fprintf(stdout, "unlink big failed\n");
     exit(EXIT_FAILURE);
   }
-  printf(stdout, "big files ok\n");
+  fprintf(stdout, "big files ok\n");
 }
 
 void
@@ -246,7 +250,7 @@ createtest(void)
 {
   int i, fd;
 
-  printf(stdout, "many creates, followed by unlink test\n");
+  fprintf(stdout, "many creates, followed by unlink test\n");
 
   name[0] = 'a';
   name[2] = '\0';
@@ -261,41 +265,41 @@ createtest(void)
     name[1] = '0' + i;
     unlink(name);
   }
-  printf(stdout, "many creates, followed by unlink; ok\n");
+  fprintf(stdout, "many creates, followed by unlink; ok\n");
 }
 
 void dirtest(void)
 {
-  printf(stdout, "mkdir test\n");
+  fprintf(stdout, "mkdir test\n");
 
   if(mkdir("dir0") < 0){
-    printf(stdout, "mkdir failed\n");
+    fprintf(stdout, "mkdir failed\n");
     exit(EXIT_FAILURE);
   }
 
   if(chdir("dir0") < 0){
-    printf(stdout, "chdir dir0 failed\n");
+    fprintf(stdout, "chdir dir0 failed\n");
     exit(EXIT_FAILURE);
   }
 
   if(chdir("..") < 0){
-    printf(stdout, "chdir .. failed\n");
+    fprintf(stdout, "chdir .. failed\n");
     exit(EXIT_FAILURE);
   }
 
   if(unlink("dir0") < 0){
-    printf(stdout, "unlink dir0 failed\n");
+    fprintf(stdout, "unlink dir0 failed\n");
     exit(EXIT_FAILURE);
   }
-  printf(stdout, "mkdir test ok\n");
+  fprintf(stdout, "mkdir test ok\n");
 }
 
 void
 exectest(void)
 {
-  printf(stdout, "exec test\n");
+  fprintf(stdout, "exec test\n");
   if(exec("echo", echoargv) < 0){
-    printf(stdout, "exec echo failed\n");
+    fprintf(stdout, "exec echo failed\n");
     exit(EXIT_FAILURE);
   }
 }
@@ -354,6 +358,554 @@ pipe1(void)
   printf(1, "pipe1 ok\n");
 }
 
+// whole page-aligned pages move through a pipe by reference,
+// copy-on-write on both sides.
+void
+pipeflip(void)
+{
+  int fds[2], i;
+  char *a, *b;
+
+  printf(1, "pipeflip test\n");
+  a = sbrk(3*4096);
+  a = (char*)(((uint)a + 4095) & ~4095);
+  b = a + 4096;
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit(EXIT_FAILURE);
+  }
+  for(i = 0; i < 4096; i++)
+    a[i] = i;
+  if(write(fds[1], a, 4096) != 4096){
+    printf(1, "pipeflip write failed\n");
+    exit(EXIT_FAILURE);
+  }
+  for(i = 0; i < 4096; i++)
+    a[i] = 0;
+  if(read(fds[0], b, 4096) != 4096){
+    printf(1, "pipeflip read failed\n");
+    exit(EXIT_FAILURE);
+  }
+  for(i = 0; i < 4096; i++){
+    if(b[i] != (char)i){
+      printf(1, "pipeflip: writer's change seen by reader\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  b[0] = 1;
+  if(a[0] != 0){
+    printf(1, "pipeflip: reader's change seen by writer\n");
+    exit(EXIT_FAILURE);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(-3*4096);
+  printf(1, "pipeflip ok\n");
+}
+
+// splice() a file into a pipe and the pipe into another file.
+void
+splicetest(void)
+{
+  int fds[2], in, out, i, n;
+
+  printf(1, "splice test\n");
+  if((in = open("splice.in", O_CREATE|O_RDWR)) < 0){
+    printf(1, "splice: cannot create splice.in\n");
+    exit(EXIT_FAILURE);
+  }
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i % 251;
+  if(write(in, buf, sizeof(buf)) != sizeof(buf)){
+    printf(1, "splice: write failed\n");
+    exit(EXIT_FAILURE);
+  }
+  close(in);
+
+  in = open("splice.in", O_RDONLY);
+  out = open("splice.out", O_CREATE|O_RDWR);
+  if(in < 0 || out < 0 || pipe(fds) != 0){
+    printf(1, "splice: open failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, sizeof(buf)) < sizeof(buf)){
+    printf(1, "splice: fcntl failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if((n = splice(in, fds[1], sizeof(buf))) != sizeof(buf)){
+    printf(1, "splice: file to pipe moved %d\n", n);
+    exit(EXIT_FAILURE);
+  }
+  close(fds[1]);
+  if((n = splice(fds[0], out, sizeof(buf) + 1)) != sizeof(buf)){
+    printf(1, "splice: pipe to file moved %d\n", n);
+    exit(EXIT_FAILURE);
+  }
+  close(fds[0]);
+  close(in);
+  close(out);
+
+  memset(buf, 0, sizeof(buf));
+  out = open("splice.out", O_RDONLY);
+  if(read(out, buf, sizeof(buf)) != sizeof(buf)){
+    printf(1, "splice: short splice.out\n");
+    exit(EXIT_FAILURE);
+  }
+  for(i = 0; i < sizeof(buf); i++){
+    if(buf[i] != (char)(i % 251)){
+      printf(1, "splice: wrong data\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  close(out);
+  unlink("splice.in");
+  unlink("splice.out");
+  printf(1, "splice ok\n");
+}
+
+static int
+sameb(char *a, char *b, int n)
+{
+  while(n-- > 0)
+    if(*a++ != *b++)
+      return 0;
+  return 1;
+}
+
+// readv/writev, pread/pwrite and lseek.
+void
+iovtest(void)
+{
+  struct iovec iov[3];
+  char a[4], b[8];
+  int fd;
+
+  printf(1, "iov test\n");
+  if((fd = open("iov", O_CREATE|O_RDWR)) < 0){
+    printf(1, "iov: cannot create\n");
+    exit(EXIT_FAILURE);
+  }
+  iov[0].iov_base = "abc";
+  iov[0].iov_len = 3;
+  iov[1].iov_base = "";
+  iov[1].iov_len = 0;
+  iov[2].iov_base = "defgh";
+  iov[2].iov_len = 5;
+  if(writev(fd, iov, 3) != 8){
+    printf(1, "iov: writev failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if(pwrite(fd, "XY", 2, 1) != 2 || lseek(fd, 0, SEEK_CUR) != 8){
+    printf(1, "iov: pwrite moved the offset\n");
+    exit(EXIT_FAILURE);
+  }
+  if(pread(fd, b, 3, 5) != 3 || !sameb(b, "fgh", 3)){
+    printf(1, "iov: pread failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if(lseek(fd, -8, SEEK_END) != 0){
+    printf(1, "iov: lseek failed\n");
+    exit(EXIT_FAILURE);
+  }
+  iov[0].iov_base = a;
+  iov[0].iov_len = sizeof(a);
+  iov[1].iov_base = b;
+  iov[1].iov_len = sizeof(b);
+  if(readv(fd, iov, 2) != 8 || !sameb(a, "aXYd", 4) || !sameb(b, "efgh", 4)){
+    printf(1, "iov: readv failed\n");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+  unlink("iov");
+  printf(1, "iov ok\n");
+}
+
+// mmap(): private and shared file mappings, msync(), partial
+// munmap(), and anonymous mappings across fork().
+void
+mmaptest(void)
+{
+  char *p, *q, *r, c;
+  int fd, i, n, pid;
+
+  printf(1, "mmap test\n");
+  if((fd = open("mmapfile", O_CREATE|O_RDWR)) < 0){
+    printf(1, "mmap: cannot create\n");
+    exit(EXIT_FAILURE);
+  }
+  n = 2*4096 + 100;
+  for(i = 0; i < 2*4096; i++)
+    buf[i] = 'a' + i % 26;
+  if(write(fd, buf, 2*4096) != 2*4096){
+    printf(1, "mmap: write failed\n");
+    exit(EXIT_FAILURE);
+  }
+  for(i = 0; i < 100; i++)
+    buf[i] = 'a' + (2*4096 + i) % 26;
+  if(write(fd, buf, 100) != 100){
+    printf(1, "mmap: write failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  p = mmap(0, n, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED){
+    printf(1, "mmap: private mapping failed\n");
+    exit(EXIT_FAILURE);
+  }
+  for(i = 0; i < 3*4096; i++)
+    if(p[i] != (i < n ? 'a' + i % 26 : 0)){
+      printf(1, "mmap: private mapping has wrong data at %d\n", i);
+      exit(EXIT_FAILURE);
+    }
+  p[0] = 'X';
+  if(pread(fd, &c, 1, 0) != 1 || c != 'a'){
+    printf(1, "mmap: private write reached the file\n");
+    exit(EXIT_FAILURE);
+  }
+
+  q = mmap(0, n, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  r = mmap(0, n, PROT_READ, MAP_SHARED, fd, 0);
+  if(q == MAP_FAILED || r == MAP_FAILED){
+    printf(1, "mmap: shared mapping failed\n");
+    exit(EXIT_FAILURE);
+  }
+  q[4096+1] = 'Y';
+  if(pread(fd, &c, 1, 4096+1) != 1 || c != 'Y' || r[4096+1] != 'Y'){
+    printf(1, "mmap: shared write not seen\n");
+    exit(EXIT_FAILURE);
+  }
+  if(pwrite(fd, "Z", 1, 2) != 1 || q[2] != 'Z'){
+    printf(1, "mmap: write() not seen by the mapping\n");
+    exit(EXIT_FAILURE);
+  }
+  if(msync(q, n) < 0){
+    printf(1, "mmap: msync failed\n");
+    exit(EXIT_FAILURE);
+  }
+  // The kernel may not write to a read-only mapping.
+  if(read(fd, r, 10) >= 0){
+    printf(1, "mmap: read() into a read-only mapping\n");
+    exit(EXIT_FAILURE);
+  }
+  if(munmap(q + 4096, 4096) < 0 || q[0] != 'a' || q[2*4096] != 'a' + 2*4096 % 26){
+    printf(1, "mmap: partial munmap failed\n");
+    exit(EXIT_FAILURE);
+  }
+  munmap(p, n);
+  munmap(q, n);
+  munmap(r, n);
+  close(fd);
+  unlink("mmapfile");
+
+  p = mmap(0, 2*4096, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANON, -1, 0);
+  q = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+  if(p == MAP_FAILED || q == MAP_FAILED){
+    printf(1, "mmap: anonymous mapping failed\n");
+    exit(EXIT_FAILURE);
+  }
+  p[0] = q[0] = 1;
+  if((pid = fork()) < 0){
+    printf(1, "mmap: fork failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if(pid == 0){
+    // The second shared page: the parent has not touched it.
+    p[0] = q[0] = p[4096] = 2;
+    exit(EXIT_SUCCESS);
+  }
+  wait(NULL);
+  if(p[0] != 2 || q[0] != 1 || p[4096] != 2){
+    printf(1, "mmap: anonymous mappings not inherited right\n");
+    exit(EXIT_FAILURE);
+  }
+  if(shmdt(p) >= 0){
+    printf(1, "mmap: shmdt() of an anonymous mapping\n");
+    exit(EXIT_FAILURE);
+  }
+  munmap(p, 2*4096);
+  munmap(q, 4096);
+  printf(1, "mmap ok\n");
+}
+
+void
+shmtest(void)
+{
+  int id, id2, pid;
+  char *p, *q;
+
+  printf(1, "shm test\n");
+  if((id = shmget(IPC_PRIVATE, 3*4096, IPC_CREAT)) < 0 || (p = shmat(id)) == (char*)-1){
+    printf(1, "shm: cannot create a private segment\n");
+    exit(EXIT_FAILURE);
+  }
+  p[0] = 1;
+  // The child touches a page the parent has not touched yet.
+  if((pid = fork()) < 0){
+    printf(1, "shm: fork failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if(pid == 0){
+    p[0] = 2;
+    p[2*4096] = 3;
+    exit(EXIT_SUCCESS);
+  }
+  wait(NULL);
+  if(p[0] != 2 || p[2*4096] != 3 || p[4096] != 0){
+    printf(1, "shm: child writes not seen\n");
+    exit(EXIT_FAILURE);
+  }
+  if(shmctl(id, IPC_RMID) < 0 || p[0] != 2 || shmat(id) != (char*)-1){
+    printf(1, "shm: IPC_RMID failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if(shmdt(p) < 0 || shmdt(p) >= 0){
+    printf(1, "shm: shmdt failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Unrelated attachments find the segment by its key.
+  if((id = shmget(1234, 4096, IPC_CREAT|IPC_EXCL)) < 0 ||
+     shmget(1234, 4096, IPC_CREAT|IPC_EXCL) >= 0 ||
+     shmget(1234, 2*4096, 0) >= 0){
+    printf(1, "shm: keyed shmget failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if((pid = fork()) < 0){
+    printf(1, "shm: fork failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if(pid == 0){
+    if((id2 = shmget(1234, 0, 0)) != id || (q = shmat(id2)) == (char*)-1)
+      exit(EXIT_FAILURE);
+    q[100] = 'x';
+    exit(EXIT_SUCCESS);
+  }
+  wait(NULL);
+  if((p = shmat(id)) == (char*)-1 || p[100] != 'x'){
+    printf(1, "shm: keyed segment not shared\n");
+    exit(EXIT_FAILURE);
+  }
+  shmdt(p);
+  shmctl(id, IPC_RMID);
+  if(shmget(1234, 0, 0) >= 0){
+    printf(1, "shm: removed segment still found\n");
+    exit(EXIT_FAILURE);
+  }
+  printf(1, "shm ok\n");
+}
+
+volatile int threadgo, threadval[4];
+char *threadmem[4][20];
+
+void
+threadfn(void *arg)
+{
+  int i = (int)arg, j;
+  char *p;
+
+  while(!threadgo)
+    ;
+  threadval[i] = i + 1;
+  // Grow the shared heap at the same time as the other threads.
+  for(j = 0; j < 20; j++){
+    if((p = sbrk(4096)) == (char*)-1)
+      return;
+    memset(p, 'a' + i, 4096);
+    threadmem[i][j] = p;
+  }
+}
+
+void
+threadtest(void)
+{
+  int i, j, tid[4];
+  void *stack;
+  char *p;
+
+  printf(1, "thread test\n");
+  threadgo = 0;
+  for(i = 0; i < 4; i++){
+    threadval[i] = 0;
+    if((tid[i] = thread_create(threadfn, (void*)i)) < 0){
+      printf(1, "thread: thread_create failed\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  // Start them together, once malloc() is done with the stacks.
+  threadgo = 1;
+  if(wait(NULL) >= 0){
+    printf(1, "thread: wait() returned a thread\n");
+    exit(EXIT_FAILURE);
+  }
+  for(i = 3; i >= 0; i--)
+    if(thread_join(tid[i]) != tid[i]){
+      printf(1, "thread: thread_join failed\n");
+      exit(EXIT_FAILURE);
+    }
+  if(join(0, &stack) >= 0){
+    printf(1, "thread: join without threads\n");
+    exit(EXIT_FAILURE);
+  }
+  for(i = 0; i < 4; i++)
+    if(threadval[i] != i + 1){
+      printf(1, "thread: write by a thread not seen\n");
+      exit(EXIT_FAILURE);
+    }
+  // Each sbrk() got its own page: all of them still hold what
+  // the thread that grew it wrote.
+  for(i = 0; i < 4; i++)
+    for(j = 0; j < 20; j++){
+      p = threadmem[i][j];
+      if(p == 0 || p[0] != 'a' + i || p[4095] != 'a' + i){
+        printf(1, "thread: concurrent sbrk() mixed pages up\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+  printf(1, "thread ok\n");
+}
+
+mutex_t futexmu;
+cond_t futexcv;
+int futexcount, futexturn;
+
+void
+futexfn(void *arg)
+{
+  int i = (int)arg, j;
+
+  for(j = 0; j < 1000; j++){
+    mutex_lock(&futexmu);
+    // Not atomic: only the mutex keeps increments from being lost.
+    futexcount = futexcount + 1;
+    if(j % 100 == 0)
+      sleep(0);
+    mutex_unlock(&futexmu);
+  }
+  // Take turns in order of i, handed over with the condvar.
+  mutex_lock(&futexmu);
+  while(futexturn != i)
+    cond_wait(&futexcv, &futexmu);
+  futexturn++;
+  cond_broadcast(&futexcv);
+  mutex_unlock(&futexmu);
+}
+
+void
+futextest(void)
+{
+  volatile uint word;
+  int i, tid[4];
+
+  printf(1, "futex test\n");
+  word = 1;
+  if(futex_wait(&word, 0) >= 0){
+    printf(1, "futex: futex_wait() slept on a changed word\n");
+    exit(EXIT_FAILURE);
+  }
+  if(futex_wake(&word, 1) != 0 || futex_wait((uint*)0x7ffffffc, 0) >= 0){
+    printf(1, "futex: futex_wake() without sleepers or bad address\n");
+    exit(EXIT_FAILURE);
+  }
+  mutex_init(&futexmu);
+  cond_init(&futexcv);
+  futexcount = 0;
+  futexturn = 0;
+  mutex_lock(&futexmu);
+  if(mutex_trylock(&futexmu) >= 0){
+    printf(1, "futex: mutex_trylock() on a held mutex\n");
+    exit(EXIT_FAILURE);
+  }
+  for(i = 0; i < 4; i++)
+    if((tid[i] = thread_create(futexfn, (void*)i)) < 0){
+      printf(1, "futex: thread_create failed\n");
+      exit(EXIT_FAILURE);
+    }
+  // The threads start out blocked on the mutex.
+  sleep(2);
+  mutex_unlock(&futexmu);
+  for(i = 0; i < 4; i++)
+    if(thread_join(tid[i]) != tid[i]){
+      printf(1, "futex: thread_join failed\n");
+      exit(EXIT_FAILURE);
+    }
+  if(futexcount != 4000 || futexturn != 4){
+    printf(1, "futex: lost update under the mutex\n");
+    exit(EXIT_FAILURE);
+  }
+  printf(1, "futex ok\n");
+}
+
+void
+polltest(void)
+{
+  struct pollfd fds[3];
+  int a[2], b[2], pid, fd, start;
+
+  printf(1, "poll test\n");
+  if(pipe(a) < 0 || pipe(b) < 0){
+    printf(1, "poll: pipe failed\n");
+    exit(EXIT_FAILURE);
+  }
+  fds[0].fd = a[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = b[0];
+  fds[1].events = POLLIN;
+  fds[2].fd = a[1];
+  fds[2].events = POLLOUT;
+  if(poll(fds, 3, 0) != 1 || fds[0].revents || fds[1].revents ||
+     fds[2].revents != POLLOUT){
+    printf(1, "poll: empty pipes\n");
+    exit(EXIT_FAILURE);
+  }
+  start = uptime();
+  if(poll(fds, 2, 2) != 0 || uptime() - start < 2){
+    printf(1, "poll: timeout\n");
+    exit(EXIT_FAILURE);
+  }
+  // Block until the child writes to the second pipe.
+  if((pid = fork()) < 0){
+    printf(1, "poll: fork failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if(pid == 0){
+    sleep(2);
+    write(b[1], "x", 1);
+    exit(EXIT_SUCCESS);
+  }
+  if(poll(fds, 2, -1) != 1 || fds[0].revents || fds[1].revents != POLLIN){
+    printf(1, "poll: no wakeup on write\n");
+    exit(EXIT_FAILURE);
+  }
+  wait(NULL);
+  close(b[1]);
+  if(read(b[0], buf, 1) != 1 || poll(fds + 1, 1, -1) != 1 ||
+     fds[1].revents != POLLHUP){
+    printf(1, "poll: no POLLHUP without writers\n");
+    exit(EXIT_FAILURE);
+  }
+  close(a[0]);
+  close(b[0]);
+  if(poll(fds, 3, -1) != 3 || fds[0].revents != POLLNVAL ||
+     fds[2].revents != POLLERR){
+    printf(1, "poll: no POLLNVAL or POLLERR\n");
+    exit(EXIT_FAILURE);
+  }
+  close(a[1]);
+  if((fd = open("README", 0)) < 0){
+    printf(1, "poll: cannot open README\n");
+    exit(EXIT_FAILURE);
+  }
+  fds[0].fd = fd;
+  fds[0].events = POLLIN | POLLOUT;
+  fds[1].fd = -1;
+  if(poll(fds, 2, -1) != 1 || fds[0].revents != POLLIN || fds[1].revents){
+    printf(1, "poll: regular file not ready\n");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+  printf(1, "poll ok\n");
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(void)
@@ -457,6 +1009,50 @@ mem(void)
   }
 }
 
+// the size-class allocator: blocks of every class keep their
+// contents, and freeing a large block on top of the heap gives
+// the memory back to the kernel.
+void
+malloctest(void)
+{
+  char *p[200], *top, *big;
+  int i, j, n;
+
+  printf(1, "malloc test\n");
+  for(i = 0; i < 200; i++){
+    n = 1 + (i * 37) % 1500;
+    if((p[i] = malloc(n)) == 0){
+      printf(1, "malloc failed\n");
+      exit(EXIT_FAILURE);
+    }
+    memset(p[i], i, n);
+  }
+  for(i = 0; i < 200; i += 2)
+    free(p[i]);
+  for(i = 1; i < 200; i += 2){
+    n = 1 + (i * 37) % 1500;
+    for(j = 0; j < n; j++)
+      if(p[i][j] != (char)i){
+        printf(1, "malloc: block %d overwritten\n", i);
+        exit(EXIT_FAILURE);
+      }
+    free(p[i]);
+  }
+
+  top = sbrk(0);
+  if((big = malloc(1024*1024)) == 0){
+    printf(1, "malloc of 1MB failed\n");
+    exit(EXIT_FAILURE);
+  }
+  big[0] = big[1024*1024-1] = 1;
+  free(big);
+  if(sbrk(0) > top){
+    printf(1, "malloc: free did not shrink the heap\n");
+    exit(EXIT_FAILURE);
+  }
+  printf(1, "malloc ok\n");
+}
+
 // More file system tests
 
 // two processes write to the same file descriptor
@@ -1201,44 +1797,44 @@ bigfile(void)
 }
 
 void
-fourteen(void)
+thirty(void)
 {
   int fd;
 
-  // DIRSIZ is 14.
-  printf(1, "fourteen test\n");
+  // DIRSIZ is 30.
+  printf(1, "thirty test\n");
 
-  if(mkdir("12345678901234") != 0){
-    printf(1, "mkdir 12345678901234 failed\n");
+  if(mkdir("123456789012345678901234567890") != 0){
+    printf(1, "mkdir 123456789012345678901234567890 failed\n");
     exit(EXIT_SUCCESS);
   }
-  if(mkdir("12345678901234/123456789012345") != 0){
-    printf(1, "mkdir 12345678901234/123456789012345 failed\n");
+  if(mkdir("123456789012345678901234567890/1234567890123456789012345678901") != 0){
+    printf(1, "mkdir 123456789012345678901234567890/1234567890123456789012345678901 failed\n");
     exit(EXIT_SUCCESS);
   }
-  fd = open("123456789012345/123456789012345/123456789012345", O_CREATE);
+  fd = open("1234567890123456789012345678901/1234567890123456789012345678901/1234567890123456789012345678901", O_CREATE);
   if(fd < 0){
-    printf(1, "create 123456789012345/123456789012345/123456789012345 failed\n");
+    printf(1, "create 1234567890123456789012345678901/1234567890123456789012345678901/1234567890123456789012345678901 failed\n");
     exit(EXIT_SUCCESS);
   }
   close(fd);
-  fd = open("12345678901234/12345678901234/12345678901234", 0);
+  fd = open("123456789012345678901234567890/123456789012345678901234567890/123456789012345678901234567890", 0);
   if(fd < 0){
-    printf(1, "open 12345678901234/12345678901234/12345678901234 failed\n");
+    printf(1, "open 123456789012345678901234567890/123456789012345678901234567890/123456789012345678901234567890 failed\n");
     exit(EXIT_SUCCESS);
   }
   close(fd);
 
-  if(mkdir("12345678901234/12345678901234") == 0){
-    printf(1, "mkdir 12345678901234/12345678901234 succeeded!\n");
+  if(mkdir("123456789012345678901234567890/123456789012345678901234567890") == 0){
+    printf(1, "mkdir 123456789012345678901234567890/123456789012345678901234567890 succeeded!\n");
     exit(EXIT_SUCCESS);
   }
-  if(mkdir("123456789012345/12345678901234") == 0){
-    printf(1, "mkdir 12345678901234/123456789012345 succeeded!\n");
+  if(mkdir("1234567890123456789012345678901/123456789012345678901234567890") == 0){
+    printf(1, "mkdir 123456789012345678901234567890/1234567890123456789012345678901 succeeded!\n");
     exit(EXIT_SUCCESS);
   }
 
-  printf(1, "fourteen ok\n");
+  printf(1, "thirty ok\n");
 }
 
 void
@@ -1418,7 +2014,7 @@ sbrktest(void)
   char *a, *b, *c, *lastaddr, *oldbrk, *p, scratch;
   uint amt;
 
-  printf(stdout, "sbrk test\n");
+  fprintf(stdout, "sbrk test\n");
   oldbrk = sbrk(0);
 
   // can one sbrk() less than a page?
@@ -1427,7 +2023,7 @@ sbrktest(void)
   for(i = 0; i < 5000; i++){
     b = sbrk(1);
     if(b != a){
-      printf(stdout, "sbrk test failed %d %x %x\n", i, a, b);
+      fprintf(stdout, "sbrk test failed %d %x %x\n", i, a, b);
       exit(EXIT_SUCCESS);
     }
     *b = 1;
@@ -1435,13 +2031,13 @@ sbrktest(void)
   }
   pid = fork();
   if(pid < 0){
-    printf(stdout, "sbrk test fork failed\n");
+    fprintf(stdout, "sbrk test fork failed\n");
     exit(EXIT_SUCCESS);
   }
   c = sbrk(1);
   c = sbrk(1);
   if(c != a + 1){
-    printf(stdout, "sbrk test failed post-fork\n");
+    fprintf(stdout, "sbrk test failed post-fork\n");
     exit(EXIT_SUCCESS);
   }
   if(pid == 0)
@@ -1454,7 +2050,7 @@ sbrktest(void)
   amt = (BIG) - (uint)a;
   p = sbrk(amt);
   if (p != a) {
-    printf(stdout, "sbrk test failed to grow big address space; enough phys mem?\n");
+    fprintf(stdout, "sbrk test failed to grow big address space; enough phys mem?\n");
     exit(EXIT_SUCCESS);
   }
   lastaddr = (char*) (BIG-1);
@@ -1464,12 +2060,12 @@ sbrktest(void)
   a = sbrk(0);
   c = sbrk(-4096);
   if(c == (char*)0xffffffff){
-    printf(stdout, "sbrk could not deallocate\n");
+    fprintf(stdout, "sbrk could not deallocate\n");
     exit(EXIT_SUCCESS);
   }
   c = sbrk(0);
   if(c != a - 4096){
-    printf(stdout, "sbrk deallocation produced wrong address, a %x c %x\n", a, c);
+    fprintf(stdout, "sbrk deallocation produced wrong address, a %x c %x\n", a, c);
     exit(EXIT_SUCCESS);
   }
 
@@ -1477,19 +2073,19 @@ sbrktest(void)
   a = sbrk(0);
   c = sbrk(4096);
   if(c != a || sbrk(0) != a + 4096){
-    printf(stdout, "sbrk re-allocation failed, a %x c %x\n", a, c);
+    fprintf(stdout, "sbrk re-allocation failed, a %x c %x\n", a, c);
     exit(EXIT_SUCCESS);
   }
   if(*lastaddr == 99){
     // should be zero
-    printf(stdout, "sbrk de-allocation didn't really deallocate\n");
+    fprintf(stdout, "sbrk de-allocation didn't really deallocate\n");
     exit(EXIT_SUCCESS);
   }
 
   a = sbrk(0);
   c = sbrk(-(sbrk(0) - oldbrk));
   if(c != a){
-    printf(stdout, "sbrk downsize failed, a %x c %x\n", a, c);
+    fprintf(stdout, "sbrk downsize failed, a %x c %x\n", a, c);
     exit(EXIT_SUCCESS);
   }
 
@@ -1498,11 +2094,11 @@ sbrktest(void)
     ppid = getpid();
     pid = fork();
     if(pid < 0){
-      printf(stdout, "fork failed\n");
+      fprintf(stdout, "fork failed\n");
       exit(EXIT_SUCCESS);
     }
     if(pid == 0){
-      printf(stdout, "oops could read %x = %x\n", a, *a);
+      fprintf(stdout, "oops could read %x = %x\n", a, *a);
       kill(ppid);
       exit(EXIT_SUCCESS);
     }
@@ -1536,14 +2132,14 @@ sbrktest(void)
     wait(NULL);
   }
   if(c == (char*)0xffffffff){
-    printf(stdout, "failed sbrk leaked memory\n");
+    fprintf(stdout, "failed sbrk leaked memory\n");
     exit(EXIT_SUCCESS);
   }
 
   if(sbrk(0) > oldbrk)
     sbrk(-(sbrk(0) - oldbrk));
 
-  printf(stdout, "sbrk test OK\n");
+  fprintf(stdout, "sbrk test OK\n");
 }
 
 void
@@ -1565,7 +2161,7 @@ validatetest(void)
   int hi, pid;
   uint p;
 
-  printf(stdout, "validate test\n");
+  fprintf(stdout, "validate test\n");
   hi = 1100*1024;
 
   for(p = 0; p <= (uint)hi; p += 4096){
@@ -1581,12 +2177,12 @@ validatetest(void)
 
     // try to crash the kernel by passing in a bad string pointer
     if(link("nosuchfile", (char*)p) != -1){
-      printf(stdout, "link should not succeed\n");
+      fprintf(stdout, "link should not succeed\n");
       exit(EXIT_SUCCESS);
     }
   }
 
-  printf(stdout, "validate ok\n");
+  fprintf(stdout, "validate ok\n");
 }
 
 // does unintialized data start out zero?
@@ -1596,14 +2192,14 @@ bsstest(void)
 {
   int i;
 
-  printf(stdout, "bss test\n");
+  fprintf(stdout, "bss test\n");
   for(i = 0; i < sizeof(uninit); i++){
     if(uninit[i] != '\0'){
-      printf(stdout, "bss test failed\n");
+      fprintf(stdout, "bss test failed\n");
       exit(EXIT_SUCCESS);
     }
   }
-  printf(stdout, "bss test ok\n");
+  fprintf(stdout, "bss test ok\n");
 }
 
 // does exec return an error if the arguments
@@ -1622,20 +2218,20 @@ bigargtest(void)
     for(i = 0; i < MAXARG-1; i++)
       args[i] = "bigargs test: failed\n                                                                                                                                                                                                       ";
     args[MAXARG-1] = 0;
-    printf(stdout, "bigarg test\n");
+    fprintf(stdout, "bigarg test\n");
     exec("echo", args);
-    printf(stdout, "bigarg test ok\n");
+    fprintf(stdout, "bigarg test ok\n");
     fd = open("bigarg-ok", O_CREATE);
     close(fd);
     exit(EXIT_SUCCESS);
   } else if(pid < 0){
-    printf(stdout, "bigargtest: fork failed\n");
+    fprintf(stdout, "bigargtest: fork failed\n");
     exit(EXIT_SUCCESS);
   }
   wait(NULL);
   fd = open("bigarg-ok", 0);
   if(fd < 0){
-    printf(stdout, "bigarg test failed!\n");
+    fprintf(stdout, "bigarg test failed!\n");
     exit(EXIT_SUCCESS);
   }
   close(fd);
@@ -1748,6 +2344,10 @@ rand()
 int
 main(int argc, char *argv[])
 {
+  struct iostat st;
+  int start;
+  uint sc0;
+
   printf(1, "usertests starting\n");
 
   if(open("usertests.ran", 0) >= 0){
@@ -1755,6 +2355,9 @@ main(int argc, char *argv[])
     exit(EXIT_SUCCESS);
   }
   close(open("usertests.ran", O_CREATE));
+  iostat(&st);
+  sc0 = st.nsyscall;
+  start = uptime();
 
   argptest();
   createdelete();
@@ -1780,12 +2383,21 @@ main(int argc, char *argv[])
   iputtest();
 
   mem();
+  malloctest();
   pipe1();
+  pipeflip();
+  splicetest();
+  iovtest();
+  mmaptest();
+  shmtest();
+  threadtest();
+  futextest();
+  polltest();
   preempt();
   exitwait();
 
   rmdot();
-  fourteen();
+  thirty();
   bigfile();
   subdir();
   linktest();
@@ -1797,6 +2409,10 @@ main(int argc, char *argv[])
 
   uio();
 
+  // System calls of the tests and of the children they waited
+  // for; most of those of the output-heavy tests are writes.
+  iostat(&st);
+  printf(1, "usertests: %d ticks, %d syscalls\n", uptime() - start, st.nsyscall - sc0);
   exectest();
 
   exit(EXIT_SUCCESS);
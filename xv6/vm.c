@@ -5,7 +5,11 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
 #include "elf.h"
+#include "traps.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -21,12 +25,19 @@ seginit(void)
   // Cannot share a CODE descriptor for both kernel and user
   // because it would have to have DPL_USR, but the CPU forbids
   // an interrupt from CPL=0 to DPL=3.
-  c = &cpus[cpuid()];
+  // %gs is not loaded yet, so mycpu() can't be used here.
+  c = findcpu();
   c->gdt[SEG_KCODE] = SEG(STA_X|STA_R, 0, 0xffffffff, 0);
   c->gdt[SEG_KDATA] = SEG(STA_W, 0, 0xffffffff, 0);
   c->gdt[SEG_UCODE] = SEG(STA_X|STA_R, 0, 0xffffffff, DPL_USER);
   c->gdt[SEG_UDATA] = SEG(STA_W, 0, 0xffffffff, DPL_USER);
+
+  // Map cpu-local storage: %gs points at this cpu's struct cpu,
+  // so mycpu() and myproc() are a single load (see proc.c).
+  c->gdt[SEG_KCPU] = SEG(STA_W, c, sizeof(*c) - 1, 0);
+  c->self = c;
   lgdt(c->gdt, sizeof(c->gdt));
+  loadgs(SEG_KCPU << 3);
 }
 
 // Return the address of the PTE in page table pgdir
@@ -177,10 +188,101 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
+  // Before loading cr3: see tlbshootdown().
+  mycpu()->mm = p->mm;
   lcr3(V2P(p->pgdir));  // switch to process's address space
   popcli();
 }
 
+// The threads of a process share its page table (see mm.h), so a
+// CPU running one of them may cache in its TLB a page that another
+// thread has just unmapped.  Before such a page is freed or loses
+// a permission, tlbshootdown() flushes the TLBs of all the CPUs
+// that run mm: this one directly, the others with an interrupt,
+// waiting until each has served it.
+//
+// A CPU sets cpu->mm before it loads cr3, and the caller changes
+// the page table before tlbshootdown() reads cpu->mm: a CPU that
+// is missed has not yet loaded cr3, and will see the new entries.
+//
+// The caller must not hold a spinlock: with interrupts off, two
+// CPUs shooting down each other would wait forever.
+void
+tlbshootdown(struct mm *mm)
+{
+  struct cpu *c;
+  uint gen[NCPU];
+  int i, n, sent[NCPU];
+
+  __sync_synchronize();
+  pushcli();
+  if(mycpu()->mm == mm)
+    lcr3(rcr3());
+  n = 0;
+  for(i = 0; i < ncpu; i++){
+    c = &cpus[i];
+    sent[i] = c != mycpu() && c->mm == mm;
+    if(sent[i]){
+      gen[i] = c->tlbgen;
+      lapicipi(c->apicid, T_TLBFLUSH);
+      n++;
+    }
+  }
+  popcli();
+  if(n == 0)
+    return;
+  if(!(readeflags() & FL_IF))
+    panic("tlbshootdown: interrupts off");
+  for(i = 0; i < ncpu; i++)
+    if(sent[i])
+      while(cpus[i].tlbgen == gen[i])
+        pause();
+}
+
+// The T_TLBFLUSH interrupt.  Counting before flushing means a
+// waiter that sees the count change knows the flush comes after
+// its page table changes, even if the interrupt was sent by
+// someone else.
+void
+tlbintr(void)
+{
+  xadd(&mycpu()->tlbgen, 1);
+  lcr3(rcr3());
+}
+
+// Unmap the user pages of mm in [start, end) and free them, once no
+// CPU can still reach them through its TLB.  Pages are freed in
+// batches, after one shootdown each.  The caller keeps other
+// threads from mapping pages there again, and holds no spinlock.
+void
+uvmunmap(pde_t *pgdir, struct mm *mm, uint start, uint end)
+{
+  char *page[64];
+  pte_t *pte;
+  uint a;
+  int i, n;
+
+  for(a = PGROUNDUP(start); a < end; ){
+    n = 0;
+    acquire(&mm->lock);
+    for(; a < end && n < NELEM(page); a += PGSIZE){
+      pte = walkpgdir(pgdir, (char*)a, 0);
+      if(!pte)
+        a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      else if(*pte & PTE_P){
+        page[n++] = P2V(PTE_ADDR(*pte));
+        *pte = 0;
+      }
+    }
+    release(&mm->lock);
+    if(n == 0)
+      continue;
+    tlbshootdown(mm);
+    for(i = 0; i < n; i++)
+      kfree(page[i]);
+  }
+}
+
 // Load the initcode into address 0 of pgdir.
 // sz must be less than a page.
 void
@@ -293,6 +395,12 @@ freevm(pde_t *pgdir, int dodeallocuvm)
     panic("freevm: no pgdir");
   if (dodeallocuvm)
     deallocuvm(pgdir, KERNBASE, 0);
+  // Threads share the page table (see clone()): only the last
+  // reference frees it.
+  if(krefcount((char*)pgdir) > 1){
+    kfree((char*)pgdir);
+    return;
+  }
   for(i = 0; i < NPDENTRIES; i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
@@ -315,6 +423,82 @@ clearpteu(pde_t *pgdir, char *uva)
   *pte &= ~PTE_U;
 }
 
+// Handle a write to the copy-on-write page at va: give the process
+// its own copy, or just make the page writable again if nobody else
+// holds it any longer. Returns -1 if va is not a copy-on-write page
+// or there is no memory for the copy. pgdir must be the current one.
+int
+cowfault(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  char *mem, *old;
+  uint flags;
+
+  pte = walkpgdir(pgdir, (void*)va, 0);
+  if(pte == 0 || !(*pte & PTE_P) || !(*pte & PTE_COW))
+    return -1;
+  old = P2V(PTE_ADDR(*pte));
+  flags = (PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW;
+  if(krefcount(old) == 1)
+    *pte = V2P(old) | flags;
+  else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, old, PGSIZE);
+    *pte = V2P(mem) | flags;
+    kfree(old);
+  }
+  lcr3(V2P(pgdir));
+  return 0;
+}
+
+// Share the user page at va, which must be page-aligned: make it
+// copy-on-write if it is writable and return it with a reference
+// added for the caller. Returns 0 if no page is mapped there yet.
+char*
+uvmshare(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  char *page;
+
+  pte = walkpgdir(pgdir, (void*)va, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))
+    return 0;
+  page = P2V(PTE_ADDR(*pte));
+  kref(page);
+  if(*pte & PTE_W){
+    *pte = (*pte & ~PTE_W) | PTE_COW;
+    lcr3(V2P(pgdir));
+  }
+  return page;
+}
+
+// Map page copy-on-write at the page-aligned user address va, in
+// place of the page there, if any. Adds a reference to page.
+// Returns -1 if va is not a user page or there is no memory for
+// the page table.
+int
+uvmmap(pde_t *pgdir, uint va, char *page)
+{
+  pte_t *pte;
+  char *old;
+
+  if((pte = walkpgdir(pgdir, (void*)va, 1)) == 0)
+    return -1;
+  old = 0;
+  if(*pte & PTE_P){
+    if(!(*pte & PTE_U))
+      return -1;
+    old = P2V(PTE_ADDR(*pte));
+  }
+  kref(page);
+  *pte = V2P(page) | PTE_P | PTE_U | PTE_COW;
+  if(old)
+    kfree(old);
+  lcr3(V2P(pgdir));
+  return 0;
+}
+
 // Given a parent process's page table, create a copy
 // of it for a child.
 pde_t*